@@ -0,0 +1,256 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "aot.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+
+Aot::Aot(Chip8 *c, const AotProgram *p) {
+    chip8 = c;
+    program = p;
+
+    memset(table, 0, sizeof(table));
+    memset(covered, false, sizeof(covered));
+
+    //Only use blocks whose memory still matches the translated ROM
+    for(uint32_t i = 0 ; i < program->blockCount ; i++) {
+        const AotBlock &block = program->blocks[i];
+
+        if(block.start < 0x200 || block.end > 0x200 + program->size)
+            continue;
+
+        if(memcmp(chip8->memory + block.start, program->image + block.start - 0x200, block.end - block.start) != 0)
+            continue;
+
+        table[block.start] = &block;
+
+        for(uint32_t addr = block.start ; addr < block.end ; addr ++)
+            covered[addr] = true;
+    }
+
+    chip8->writeHook = &Aot::writeHook;
+    chip8->writeHookData = this;
+}
+
+Aot::~Aot() {
+    chip8->writeHook = nullptr;
+    chip8->writeHookData = nullptr;
+}
+
+void Aot::writeHook(void *aot, uint16_t addr, uint16_t len) {
+    ((Aot*)aot)->invalidate(addr, len);
+}
+
+//Disable blocks that read memory in [addr, addr + len)
+void Aot::invalidate(uint16_t addr, uint16_t len) {
+
+    uint32_t low = addr;
+    uint32_t high = (uint32_t)addr + len;
+
+    //Most writes don't touch code
+    bool hit = false;
+
+    for(uint32_t i = low ; i < high && i < 0x10000 ; i++)
+        hit |= covered[i];
+
+    if(!hit)
+        return;
+
+    for(uint32_t i = 0 ; i < program->blockCount ; i++) {
+        const AotBlock &block = program->blocks[i];
+
+        if(table[block.start] == &block && block.start < high && block.end > low) {
+            table[block.start] = nullptr;
+            blocksInvalidated ++;
+        }
+    }
+}
+
+//Emulate a number of instructions, running translated blocks when possible
+//Same stop reasons and budget accounting as Chip8::run
+StopReason Aot::run(uint32_t cycles) {
+
+    Chip8 &c = *chip8;
+
+    c.cyclesLeft = cycles;
+    c.idleArmed = false;
+
+    if(c.stopped)
+        return STOP_HALT;
+
+    if(c.waiting)
+        return STOP_KEYWAIT;
+
+    while(cycles > 0) {
+
+        const AotBlock *block = table[c.pc];
+
+        if(block != nullptr && block->count <= cycles) {
+            c.pc = block->code(c);
+            cycles -= block->count;
+            nativeInstructions += block->count;
+
+            //Idle loop detection, as in the interpreter
+            if(block->jump != 0 && (uint16_t)(block->jump - c.pc) < IDLE_MAX_SPAN && cycles > 0) {
+                if(c.cache[block->jump].handler == nullptr)
+                    c.decode(block->jump);
+
+                cycles -= c.idleSkip(block->jump, cycles);
+            }
+
+            continue;
+        }
+
+        //Untranslated, modified, or not enough budget left for the block
+        uint16_t pc = c.pc;
+
+        c.emulateInstruction();
+        interpretedInstructions ++;
+        cycles --;
+
+        uint8_t op = c.cache[pc].op;
+
+        if(op == OP_UNKNOWN || op == OP_00FD || op == OP_FX0A) {
+            c.cyclesLeft = cycles;
+
+            if(op == OP_UNKNOWN)
+                return STOP_UNKNOWN;
+
+            return (op == OP_00FD) ? STOP_HALT : STOP_KEYWAIT;
+        }
+    }
+
+    c.cyclesLeft = 0;
+    return STOP_BUDGET;
+}
+
+//Headless runner
+//usage: program rom_file [-b frames] [-i]
+int aotMain(int argc, char **argv, const AotProgram *program) {
+
+    if(argc < 2) {
+        std::cout << "usage: " << argv[0] << " rom_file [options]" << std::endl;
+        std::cout << " options :" << std::endl;
+        std::cout << "  -b frames    number of frames to run (default 60)" << std::endl;
+        std::cout << "  -i    use the interpreter instead of the translated code" << std::endl;
+        std::cout << "  -m [auto chip8 schip xochip skyward]    machine type, as in the emulator" << std::endl;
+        std::cout << " translated from " << program->name << std::endl;
+
+        return 0;
+    }
+
+    //Machine types and their quirks, auto runs unknown programs as CHIP-8 like the emulator
+    const char *machines[] = {"auto", "chip8", "schip", "xochip", "skyward"};
+    const uint8_t quirks[] = {QUIRKS_CHIP8, QUIRKS_CHIP8, QUIRKS_SCHIP, QUIRKS_XOCHIP, QUIRKS_SKYWARD};
+
+    int frames = 60;
+    bool interpret = false;
+    int machine = 0;
+
+    for(int i = 2 ; i < argc ; i++) {
+        if(strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            sscanf(argv[++i], "%d", &frames);
+        else if(strcmp(argv[i], "-i") == 0)
+            interpret = true;
+        else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            i++;
+            machine = -1;
+
+            for(int j = 0 ; j < 5 ; j++)
+                if(strcmp(argv[i], machines[j]) == 0)
+                    machine = j;
+
+            if(machine < 0) {
+                std::cout << "Unknown machine type " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    Chip8 *chip8 = new Chip8();
+
+    //Set before loading, programs.json may still override them
+    chip8->setQuirks(quirks[machine]);
+
+    if(chip8->loadROM(argv[1]) != 0)
+        return 1;
+
+    uint32_t crc = crc32(0, (Bytef *) chip8->memory + 0x200, chip8->romSize);
+
+    if(crc != program->crc)
+        std::cout << "ROM differs from the translated one, only matching blocks will be used" << std::endl;
+
+    Aot *aot = interpret ? nullptr : new Aot(chip8, program);
+
+    std::cout << "Emulating " << std::dec << frames << " frames of " << chip8->tickRate << " instructions" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(int i = 0 ; i < frames ; i++) {
+        uint32_t cycles = chip8->tickRate;
+
+        //Unknown opcodes don't interrupt the frame
+        while(cycles > 0) {
+            StopReason reason = aot ? aot->run(cycles) : chip8->run(cycles);
+            cycles = chip8->cyclesLeft;
+
+            if(reason != STOP_UNKNOWN && reason != STOP_BREAKPOINT)
+                break;
+        }
+
+        chip8->updateTimers();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double instructions = (double)frames * chip8->tickRate;
+
+    std::cout << "Elapsed : " << elapsed.count() << " s" << std::endl;
+    std::cout << "Speed : " << instructions / elapsed.count() / 1000000.0 << " MIPS" << std::endl;
+
+    if(aot != nullptr) {
+        std::cout << "Native instructions : " << aot->nativeInstructions << std::endl;
+        std::cout << "Interpreted instructions : " << aot->interpretedInstructions << std::endl;
+        std::cout << "Blocks invalidated : " << aot->blocksInvalidated << std::endl;
+    }
+
+    //Final state, to compare with the interpreter
+    std::cout << std::hex << std::setfill('0');
+    std::cout << "PC : " << std::setw(4) << chip8->pc << " I : " << std::setw(4) << chip8->I << " V :";
+
+    for(uint8_t i = 0 ; i < 16 ; i++)
+        std::cout << " " << std::setw(2) << (int)chip8->v[i];
+
+    std::cout << std::endl;
+    std::cout << "Display CRC32 : " << crc32(0, (Bytef *) chip8->gfx, sizeof(chip8->gfx)) << std::endl;
+
+    delete aot;
+    delete chip8;
+
+    return 0;
+}
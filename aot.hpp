@@ -0,0 +1,89 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef AOT_HPP_INCLUDED
+#define AOT_HPP_INCLUDED
+
+#include <cstdint>
+
+#include "chip8.hpp"
+
+//Translated block function, returns the next pc
+typedef uint16_t (*AotFunction)(Chip8&);
+
+//Block translated by ch8recomp
+struct AotBlock {
+    uint16_t start;     //Address of the first instruction
+    uint32_t end;       //End of the memory range the block was translated from
+    uint32_t count;     //Instructions executed by the block
+    uint16_t jump;      //Address of a final 1NNN, 0 if none
+    AotFunction code;
+};
+
+//Program translated by ch8recomp
+struct AotProgram {
+    const char *name;
+    uint32_t crc;
+    const uint8_t *image;   //ROM contents at translation time
+    uint32_t size;
+    const AotBlock *blocks;
+    uint32_t blockCount;
+};
+
+//Runtime for programs translated ahead of time
+//Runs translated blocks when the memory they were translated from is
+//unchanged, and falls back to the interpreter everywhere else.
+class Aot {
+
+public:
+
+    Chip8 *chip8;
+    const AotProgram *program;
+
+    //Statistics
+    uint64_t nativeInstructions = 0;
+    uint64_t interpretedInstructions = 0;
+    uint64_t blocksInvalidated = 0;
+
+    Aot(Chip8*, const AotProgram*);
+    ~Aot();
+
+    StopReason run(uint32_t);
+    void invalidate(uint16_t, uint16_t);
+
+private:
+
+    //Valid block starting at each address
+    const AotBlock *table[0x10000];
+
+    //Memory read by translated blocks
+    bool covered[0x10000];
+
+    static void writeHook(void*, uint16_t, uint16_t);
+};
+
+//Headless runner used as the main function of translated programs
+int aotMain(int, char**, const AotProgram*);
+
+#endif // AOT_HPP_INCLUDED
@@ -0,0 +1,313 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "audio.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+Audio::Audio(uint32_t rate) {
+    this->rate = rate;
+}
+
+uint32_t Audio::frameSamples() {
+    frameRemainder += rate;
+
+    uint32_t samples = frameRemainder / AUDIO_FRAME_RATE;
+    frameRemainder %= AUDIO_FRAME_RATE;
+
+    return samples;
+}
+
+//Windowed sinc impulse, cut off below the Nyquist frequency, x in output samples from its center
+static double impulse(double x) {
+    const double cutoff = 0.9;
+
+    double sinc = (x == 0) ? 1 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+
+    //Blackman window over the taps
+    double w = (x + BLEP_TAPS / 2) / BLEP_TAPS;
+    return sinc * (0.42 - 0.5 * cos(2 * M_PI * w) + 0.08 * cos(4 * M_PI * w));
+}
+
+//Band-limited steps, as the differences between successive output samples
+//Row p is the impulse centered p / BLEP_PHASES samples after tap BLEP_TAPS / 2 - 1. Each row adds up to 1.
+//Rise is the whole step from 0 to 1, one point every 1 / BLEP_PHASES sample, for the loops played from a table.
+static const struct BlepTable {
+    float table[BLEP_PHASES + 1][BLEP_TAPS];
+    float rise[BLEP_TAPS * BLEP_PHASES + 1];
+
+    BlepTable() {
+        for(uint32_t p = 0 ; p <= BLEP_PHASES ; p ++) {
+            double total = 0;
+
+            for(uint32_t k = 0 ; k < BLEP_TAPS ; k ++) {
+                table[p][k] = impulse(k - (BLEP_TAPS / 2 - 1) - (double)p / BLEP_PHASES);
+                total += table[p][k];
+            }
+
+            for(uint32_t k = 0 ; k < BLEP_TAPS ; k ++)
+                table[p][k] /= total;
+        }
+
+        double area = 0;
+
+        for(uint32_t k = 1 ; k <= BLEP_TAPS * BLEP_PHASES ; k ++) {
+            area += impulse((k - 0.5) / BLEP_PHASES - BLEP_TAPS / 2);
+            rise[k] = area;
+        }
+
+        for(uint32_t k = 0 ; k <= BLEP_TAPS * BLEP_PHASES ; k ++)
+            rise[k] /= area;
+    }
+} blep;
+
+//Add a band-limited step of delta at time t, in 1/2^32 output samples from the start of the frame
+void Audio::step(uint64_t t, float delta) {
+    const float *taps = blep.table[((uint64_t)(uint32_t)t * BLEP_PHASES + 0x80000000u) >> 32];
+    float *out = deltas + (t >> 32);
+
+    for(uint32_t k = 0 ; k < BLEP_TAPS ; k ++)
+        out[k] += delta * taps[k];
+}
+
+//Sample of the audio buffer, or of the buzzer
+static inline bool bufferBit(const Chip8 *chip8, uint32_t index) {
+    return chip8->audioPattern ? (chip8->audioBuffer[index >> 3] >> (7 - (index & 7))) & 1 : index < 64;
+}
+
+//Band-limited steps at each change until the end of the block
+void Audio::renderSteps(const Chip8 *chip8, uint32_t count, double rate) {
+
+    //The current buffer sample starts at the beginning of the block
+    uint32_t index = (uint32_t)phase;
+    float target = bufferBit(chip8, index) ? AUDIO_VOLUME : -AUDIO_VOLUME;
+
+    if(target != level)
+        step(0, target - level);
+
+    //Each buffer sample comes 1 / rate output samples after the previous one, times are in 1/2^32 output samples
+    //Start from the first change after the current sample, cycle is when sample 0 of its loop of the buffer comes
+    uint64_t period = (uint64_t)(4294967296.0 / rate);
+    uint64_t end = (uint64_t)count << 32;
+    uint64_t cycle = (uint64_t)((index + 1 - phase) / rate * 4294967296.0) - (index + 1) * period;
+    uint32_t j = 0;
+
+    while(j < changeCount && changes[j] <= index)
+        j ++;
+
+    if(j == changeCount) {
+        j = 0;
+        cycle += 128 * period;
+    }
+
+    //Steps alternate, a change takes the level to the other side
+    float delta = -2 * target;
+
+    for(uint64_t time ; changeCount > 0 && (time = cycle + changes[j] * period) < end ; delta = -delta) {
+        step(time, delta);
+
+        if(++j == changeCount) {
+            j = 0;
+            cycle += 128 * period;
+        }
+    }
+
+    level = -delta / 2;
+}
+
+//One loop of the buffer as heard at this rate, tableSize points, band-limited like the steps
+//The buffer is held for the points of each sample, then each change adds what its band-limited step
+//differs from the held one, sampled at the points of the table : it costs the step width per change.
+//The table is as small as linear interpolation between its points allows.
+void Audio::buildTable(const Chip8 *chip8, double rate) {
+
+    for(tableSize = 128 ; tableSize < AUDIO_TABLE && rate * tableSize / 128 < AUDIO_TABLE_RATE ; tableSize <<= 1);
+
+    const uint32_t spacing = tableSize / 128;
+    const uint32_t mask = tableSize - 1;
+
+    for(uint32_t k = 0 ; k < 128 ; k ++)
+        std::fill(table + k * spacing, table + (k + 1) * spacing, bufferBit(chip8, k) ? AUDIO_VOLUME : -AUDIO_VOLUME);
+
+    //Band-limited step less the held one, BLEP_TAPS output samples wide centered on the change
+    double points = rate * tableSize / 128;
+    uint32_t half = (uint32_t)(BLEP_TAPS / 2 * points);
+    std::vector<float> residual(2 * half);
+
+    for(uint32_t k = 0 ; k < 2 * half ; k ++) {
+        double x = ((double)k - half) / points * BLEP_PHASES + BLEP_TAPS / 2 * BLEP_PHASES;
+        uint32_t i = std::min((uint32_t)x, (uint32_t)(BLEP_TAPS * BLEP_PHASES - 1));
+
+        residual[k] = blep.rise[i] + (blep.rise[i + 1] - blep.rise[i]) * (float)(x - i) - (k >= half);
+    }
+
+    //Past the end of the table they wrap around
+    std::vector<float> wrapped(tableSize + 2 * half);
+
+    for(uint32_t j = 0 ; j < changeCount ; j ++) {
+        float delta = bufferBit(chip8, changes[j]) ? 2 * AUDIO_VOLUME : -2 * AUDIO_VOLUME;
+        float *d = wrapped.data() + ((changes[j] * spacing - half) & mask);
+
+        for(uint32_t k = 0 ; k < 2 * half ; k ++)
+            d[k] += delta * residual[k];
+    }
+
+    for(uint32_t m = 0 ; m < tableSize + 2 * half ; m ++)
+        table[m & mask] += wrapped[m];
+
+    table[tableSize] = table[0];
+}
+
+//Output sample nearest to a level
+static int16_t rounded(float level) {
+    return (int16_t)(level + (level < 0 ? -0.5f : 0.5f));
+}
+
+//Play the band-limited loop from the table, for patterns changing too often for steps, and return the output samples written
+//Past the tails of earlier steps the output is the loop itself, delayed as much as the steps : it's written directly,
+//only the first BLEP_TAPS samples and the differences carried over to the next block go through the buffer of differences.
+uint32_t Audio::renderTable(int16_t *out, uint32_t count, double rate) {
+
+    if(count == 0)
+        return 0;
+
+    //Positions in the loop in 1/2^32 loops, the point of the table in the high bits, how far to the next one in the others
+    const uint32_t shift = 32 - __builtin_ctz(tableSize);
+    const uint32_t fraction = (1u << shift) - 1;
+    const float scale = 1.0f / (1u << shift);
+    uint32_t position = (uint32_t)(phase / 128 * 4294967296.0);
+    uint32_t increment = (uint32_t)(rate / 128 * 4294967296.0);
+
+    float levels[AUDIO_BLOCK];
+
+    for(uint32_t i = 0 ; i < count ; i ++, position += increment) {
+        uint32_t j = position >> shift;
+        float f = (int32_t)(position & fraction) * scale;
+        levels[i] = table[j] + (table[j + 1] - table[j]) * f;
+    }
+
+    //Band-limited step from the previous level to the loop, unless the loop was already playing, then the loop
+    const uint32_t delay = BLEP_TAPS / 2 - 1;
+
+    if(looping)
+        deltas[delay] += levels[0] - level;
+    else
+        step(0, levels[0] - level);
+
+    looping = true;
+
+    for(uint32_t i = 1 ; i < count && i + delay < BLEP_TAPS ; i ++)
+        deltas[i + delay] += levels[i] - levels[i - 1];
+
+    for(uint32_t i = std::max(count, (uint32_t)BLEP_TAPS) - delay ; i < count ; i ++)
+        deltas[i + delay] += levels[i] - levels[i - 1];
+
+    level = levels[count - 1];
+
+    uint32_t summed = std::min(count, (uint32_t)BLEP_TAPS);
+
+    for(uint32_t i = 0 ; i < summed ; i ++) {
+        sum += deltas[i];
+        out[i] = rounded(sum);
+    }
+
+    for(uint32_t i = summed ; i < count ; i ++)
+        out[i] = rounded(levels[i - delay]);
+
+    if(count > summed)
+        sum = levels[count - 1 - delay];
+
+    return count;
+}
+
+void Audio::renderBlock(const Chip8 *chip8, int16_t *out, uint32_t count) {
+
+    //Buzzer : square wave, one period is half a buffer of ones then half a buffer of zeros
+    bool buzzer = !chip8->audioPattern;
+
+    //Audio buffer samples per output sample
+    double rate = buzzer ? 128.0 * AUDIO_BUZZER / this->rate : 4000.0 * pow(2.0, (chip8->pitch - 64) / 48.0) / this->rate;
+
+    //Output samples already written
+    uint32_t written = 0;
+
+    if(chip8->soundTimer == 0) {
+        if(level != 0)
+            step(0, -level);
+
+        level = 0;
+        looping = false;
+    }
+    else {
+        //Buffer samples that change the level, found again only when the program loads another pattern
+        if(changesBuzzer != buzzer || memcmp(changesPattern, chip8->audioBuffer, sizeof(changesPattern)) != 0) {
+            changesBuzzer = buzzer;
+            memcpy(changesPattern, chip8->audioBuffer, sizeof(changesPattern));
+            changeCount = 0;
+
+            for(uint32_t k = 0 ; k < 128 ; k ++)
+                if(bufferBit(chip8, k) != bufferBit(chip8, (k - 1) & 127))
+                    changes[changeCount++] = k;
+
+            tableRate = 0;
+        }
+
+        //Frequent changes cost less from the table, when it's fine enough for this rate
+        if(changeCount * rate / 128 > AUDIO_TABLE_CHANGES && rate * AUDIO_TABLE / 128 >= AUDIO_TABLE_RATE) {
+            if(rate != tableRate) {
+                buildTable(chip8, rate);
+                tableRate = rate;
+                looping = false;
+            }
+
+            written = renderTable(out, count, rate);
+        }
+        else {
+            renderSteps(chip8, count, rate);
+            looping = false;
+        }
+
+        phase = fmod(phase + rate * count, 128);
+    }
+
+    for(uint32_t i = written ; i < count ; i ++) {
+        sum += deltas[i];
+        out[i] = rounded(sum);
+    }
+
+    //Keep the tails of the last steps for the next frame
+    memmove(deltas, deltas + count, BLEP_TAPS * sizeof(float));
+    memset(deltas + BLEP_TAPS, 0, count * sizeof(float));
+}
+
+void Audio::render(const Chip8 *chip8, int16_t *out, uint32_t count) {
+    for( ; count > AUDIO_BLOCK ; count -= AUDIO_BLOCK, out += AUDIO_BLOCK)
+        renderBlock(chip8, out, AUDIO_BLOCK);
+
+    renderBlock(chip8, out, count);
+}
@@ -0,0 +1,125 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef AUDIO_HPP_INCLUDED
+#define AUDIO_HPP_INCLUDED
+
+#include <cstdint>
+
+#include "chip8.hpp"
+
+//Frames per second, the rate of the CHIP-8 timers
+#define AUDIO_FRAME_RATE 60
+
+//Frequency of the buzzer, for programs that never fill the audio buffer
+#define AUDIO_BUZZER 440
+
+#define AUDIO_VOLUME 6000
+
+//Band-limited steps : taps per step, and table rows per sample
+#define BLEP_TAPS 16
+#define BLEP_PHASES 64
+
+//Band-limited loop of the buffer : most points, level changes per output sample above which it's
+//cheaper than steps, and the fewest points per output sample for interpolating the highest harmonic
+#define AUDIO_TABLE 4096
+#define AUDIO_TABLE_CHANGES 0.1
+#define AUDIO_TABLE_RATE 7
+
+//Samples rendered at once, longer frames are split
+#define AUDIO_BLOCK 1024
+
+//Sound generator
+//Renders what a Chip8 plays one frame at a time, on the emulation thread.
+//XO-CHIP programs play their 128-sample audio buffer in a loop at the rate
+//set by the pitch register, other programs a square wave buzzer.
+//Sound is on while the sound timer is running.
+//
+//The output only changes where a 1-bit sample differs from the previous
+//one. Each change adds a band-limited step, precomputed for BLEP_PHASES
+//positions between two output samples, to a buffer of differences, and
+//the output is the running sum of that buffer. Changes are found once per
+//pattern, so a change costs BLEP_TAPS multiply-adds, an output sample one
+//add, and there is no oversampling. Output is delayed by BLEP_TAPS / 2 samples.
+//Patterns changing more than AUDIO_TABLE_CHANGES times per output sample
+//are played from a table instead : one loop of the buffer with the same
+//band-limited steps at a finer resolution, built once per pattern and
+//pitch. An output sample then costs a linear interpolation whatever the
+//pattern, written directly once the tails of earlier steps are over.
+class Audio {
+
+public:
+
+    Audio(uint32_t);
+
+    //Output sample rate
+    uint32_t rate;
+
+    //Samples in the next frame
+    //Frames alternate between rate / AUDIO_FRAME_RATE and one more sample, so they add up to rate per second
+    uint32_t frameSamples();
+
+    void render(const Chip8*, int16_t*, uint32_t);
+
+private:
+
+    //Position in the audio buffer, in samples of the buffer
+    double phase = 0;
+
+    //Output level after the last step
+    float level = 0;
+
+    //Running sum of the differences
+    float sum = 0;
+
+    //Differences of the output, including the tails of steps past the frame
+    float deltas[AUDIO_BLOCK + BLEP_TAPS] = {};
+
+    //Buffer samples that differ from the previous one, for the pattern they were found in
+    uint8_t changes[128] = {};
+    uint32_t changeCount = 0;
+
+    uint8_t changesPattern[16] = {};
+    bool changesBuzzer = false;
+
+    //Band-limited loop of the buffer, for the pattern above and this many buffer samples per output sample, 0 before it's built
+    float table[AUDIO_TABLE + 1] = {};
+    uint32_t tableSize = AUDIO_TABLE;
+    double tableRate = 0;
+
+    //The last block was played from this table, the next one carries on without a step
+    bool looping = false;
+
+    //Remainder of rate / AUDIO_FRAME_RATE carried over to the next frame
+    uint32_t frameRemainder = 0;
+
+    void step(uint64_t, float);
+    void renderSteps(const Chip8*, uint32_t, double);
+    void buildTable(const Chip8*, double);
+    uint32_t renderTable(int16_t*, uint32_t, double);
+    void renderBlock(const Chip8*, int16_t*, uint32_t);
+};
+
+#endif // AUDIO_HPP_INCLUDED
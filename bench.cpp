@@ -0,0 +1,355 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+//ch8bench : microbenchmarks of the emulator's inner kernels
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "chip8.hpp"
+#include "scroll.hpp"
+#include "compose.hpp"
+#include "scale.hpp"
+#include "audio.hpp"
+
+#define AUDIO_BENCH_RATE 48000
+
+using namespace std;
+
+//Scroll as done before the framebuffer was bit-packed, one bool per pixel
+static bool bytePlane[SCHIP_WH];
+
+static void byteLeft(uint8_t pixels) {
+    for(uint8_t y0 = 0 ; y0 < SCHIP_H ; y0 ++) {
+        memmove(bytePlane + y0*SCHIP_W,   bytePlane + pixels + y0*SCHIP_W,   SCHIP_W - pixels);
+        memset(bytePlane + SCHIP_W - pixels + y0*SCHIP_W,   false,   pixels);
+    }
+}
+
+static void byteRight(uint8_t pixels) {
+    for(uint8_t y0 = 0 ; y0 < SCHIP_H ; y0 ++) {
+        memmove(bytePlane + pixels + y0*SCHIP_W,   bytePlane + y0*SCHIP_W,   SCHIP_W - pixels);
+        memset(bytePlane + y0*SCHIP_W,   false,   pixels);
+    }
+}
+
+//Nanoseconds per call of a function run n times
+template<typename F>
+static double timeCalls(uint32_t n, F f) {
+    auto start = chrono::steady_clock::now();
+
+    for(uint32_t i = 0 ; i < n ; i++)
+        f();
+
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+
+    return elapsed.count() / n;
+}
+
+//00FB / 00FC on one bitplane
+static void benchScroll(uint32_t n) {
+
+    cout << "Scroll kernels (one bitplane, 4 pixels left then right) :" << endl;
+
+    vector<const ScrollKernels*> kernels = {&scrollScalar};
+
+#ifdef SCROLL_X64
+    if(__builtin_cpu_supports("sse2"))
+        kernels.push_back(&scrollSse2);
+
+    if(__builtin_cpu_supports("avx2"))
+        kernels.push_back(&scrollAvx2);
+#endif
+
+    alignas(32) uint64_t reference[SCHIP_H][2];
+    alignas(32) uint64_t plane[SCHIP_H][2];
+
+    srand(1);
+
+    for(uint8_t y = 0 ; y < SCHIP_H ; y++)
+        for(uint8_t w = 0 ; w < 2 ; w++)
+            reference[y][w] = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand();
+
+    for(uint32_t i = 0 ; i < SCHIP_WH ; i++)
+        bytePlane[i] = (reference[i / SCHIP_W][(i % SCHIP_W) >> 6] >> (63 - (i & 63))) & 1;
+
+    double ns = timeCalls(n, [] { byteLeft(4); byteRight(4); });
+    cout << "  " << setw(8) << left << "bytes" << right << fixed << setprecision(1) << setw(10) << ns << " ns  (previous layout)" << endl;
+
+    for(const ScrollKernels *k : kernels) {
+
+        //Check against the scalar kernels
+        for(uint8_t pixels = 1 ; pixels < 64 ; pixels++) {
+            alignas(32) uint64_t expected[SCHIP_H][2];
+
+            memcpy(expected, reference, sizeof(expected));
+            memcpy(plane, reference, sizeof(plane));
+            scrollScalar.left(expected, pixels);
+            k->left(plane, pixels);
+            scrollScalar.right(expected, pixels);
+            k->right(plane, pixels);
+
+            if(memcmp(expected, plane, sizeof(plane)) != 0) {
+                cout << "  " << k->name << " : wrong result when scrolling " << (int)pixels << " pixels" << endl;
+                break;
+            }
+        }
+
+        memcpy(plane, reference, sizeof(plane));
+
+        ns = timeCalls(n, [&] { k->left(plane, 4); k->right(plane, 4); });
+        cout << "  " << setw(8) << left << k->name << right << setw(10) << ns << " ns" << (k == selectScrollKernels() ? "  (selected)" : "") << endl;
+    }
+}
+
+//Palette lookup as done before the palette kernels, one byte per pixel and plane
+static bool bytePlanes[2][SCHIP_WH];
+
+static void byteCompose(uint8_t palette[4][3], bool fullPalette, uint32_t *out) {
+    for(uint32_t i = 0 ; i < SCHIP_WH ; i++) {
+        uint8_t col = (bytePlanes[1][i] << 1) + bytePlanes[0][i];
+
+        if(!fullPalette && col > 0)
+            col = 3;
+
+        out[i] = (palette[col][0] << 24) | (palette[col][1] << 16) | (palette[col][2] << 8) | 0xFF;
+    }
+}
+
+//Both bitplanes to RGBA, whole screen
+static void benchCompose(uint32_t n) {
+
+    cout << "Palette kernels (whole screen, both planes) :" << endl;
+
+    vector<const ComposeKernel*> kernels = {&composeScalar};
+
+#ifdef COMPOSE_X64
+    if(__builtin_cpu_supports("ssse3"))
+        kernels.push_back(&composeSsse3);
+
+    if(__builtin_cpu_supports("avx2"))
+        kernels.push_back(&composeAvx2);
+#endif
+
+    alignas(32) uint64_t gfx[2][SCHIP_H][2];
+    uint8_t palette[4][3];
+    uint32_t colors[4];
+    vector<uint32_t> expected(SCHIP_WH), out(SCHIP_WH);
+
+    srand(2);
+
+    for(uint8_t p = 0 ; p < 2 ; p++)
+        for(uint8_t y = 0 ; y < SCHIP_H ; y++)
+            for(uint8_t w = 0 ; w < 2 ; w++)
+                gfx[p][y][w] = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand();
+
+    for(uint8_t c = 0 ; c < 4 ; c++) {
+        for(uint8_t b = 0 ; b < 3 ; b++)
+            palette[c][b] = rand();
+
+        colors[c] = (palette[c][0] << 24) | (palette[c][1] << 16) | (palette[c][2] << 8) | 0xFF;
+    }
+
+    for(uint8_t p = 0 ; p < 2 ; p++)
+        for(uint32_t i = 0 ; i < SCHIP_WH ; i++)
+            bytePlanes[p][i] = (gfx[p][i / SCHIP_W][(i % SCHIP_W) >> 6] >> (63 - (i & 63))) & 1;
+
+    double ns = timeCalls(n, [&] { byteCompose(palette, true, out.data()); });
+    cout << "  " << setw(8) << left << "bytes" << right << fixed << setprecision(1) << setw(10) << ns << " ns  (previous layout)" << endl;
+
+    composeScalar.compose(gfx, colors, ~0ull, 2, expected.data());
+
+    for(const ComposeKernel *k : kernels) {
+
+        //Check against the scalar kernel, on every row
+        fill(out.begin(), out.end(), 0);
+        k->compose(gfx, colors, ~0ull, 2, out.data());
+
+        if(out != expected)
+            cout << "  " << k->name << " : wrong result" << endl;
+
+        //then on a few lores rows
+        fill(out.begin(), out.end(), 0);
+        k->compose(gfx, colors, 0x0000000080000101ull, 1, out.data());
+
+        for(uint32_t i = 0 ; i < SCHIP_WH ; i++) {
+            uint32_t y = i / SCHIP_W;
+            bool drawn = (y == 0 || y == 8 || y == 31) && (i % SCHIP_W) < CHIP_W;
+
+            if(out[i] != (drawn ? expected[i] : 0)) {
+                cout << "  " << k->name << " : wrong rows drawn" << endl;
+                break;
+            }
+        }
+
+        ns = timeCalls(n, [&] { k->compose(gfx, colors, ~0ull, 2, out.data()); });
+        cout << "  " << setw(8) << left << k->name << right << setw(10) << ns << " ns" << (k == selectComposeKernel() ? "  (selected)" : "") << endl;
+    }
+}
+
+//Upscalers on a composed hires screen
+static void benchScale(uint32_t n) {
+
+    cout << "Scalers (hires screen, ns per frame) :" << endl;
+
+    vector<uint32_t> screen(SCHIP_WH);
+    vector<uint32_t> expected(SCHIP_WH * 16), out(SCHIP_WH * 16);
+
+    //Four colors in short runs, so the edge rules are exercised
+    srand(3);
+
+    for(uint32_t i = 0 ; i < SCHIP_WH ; i++)
+        screen[i] = (rand() % 3 == 0) ? 0xFF000000u * (rand() % 4) + 0xFF : (i > 0 ? screen[i - 1] : 0xFF);
+
+    for(uint32_t s = 0 ; s < SCALER_COUNT ; s++) {
+        const Scaler *scalar = &scalersScalar[s];
+        uint32_t f = scalar->factor;
+
+        vector<const Scaler*> kernels = {scalar};
+
+#ifdef SCALE_X64
+        if(__builtin_cpu_supports("sse2"))
+            kernels.push_back(&scalersSse2[s]);
+#endif
+
+        cout << "  " << setw(8) << left << scalar->name << right;
+
+        for(const Scaler *k : kernels) {
+
+            //Check against the scalar kernel, on the hires and lores screen sizes
+            for(uint32_t lores = 0 ; lores < 2 ; lores++) {
+                uint32_t w = lores ? CHIP_W : SCHIP_W;
+                uint32_t h = lores ? CHIP_H : SCHIP_H;
+
+                fill(out.begin(), out.end(), 0);
+                fill(expected.begin(), expected.end(), 0);
+                scalar->scale(screen.data(), w, h, SCHIP_W, expected.data(), SCHIP_W * f);
+                k->scale(screen.data(), w, h, SCHIP_W, out.data(), SCHIP_W * f);
+
+                if(out != expected)
+                    cout << "  (wrong result" << (lores ? " in lores)" : ")");
+            }
+
+            double ns = timeCalls(n, [&] { k->scale(screen.data(), SCHIP_W, SCHIP_H, SCHIP_W, out.data(), SCHIP_W * f); });
+            cout << setw(10) << fixed << setprecision(1) << ns << " " << (k == scalar ? "scalar" : "sse2  ") << (k == findScaler(k->name) ? " (selected)" : "");
+        }
+
+        cout << endl;
+    }
+}
+
+//Audio rendering as done before band-limited steps, one point sample of the buffer per output sample
+static void naiveRender(const Chip8 *chip8, double &phase, int16_t *out, uint32_t count) {
+    double step = 4000.0 * pow(2.0, (chip8->pitch - 64) / 48.0) / AUDIO_BENCH_RATE;
+
+    for(uint32_t i = 0 ; i < count ; i++) {
+        uint8_t bit = (uint8_t)phase;
+
+        out[i] = ((chip8->audioBuffer[bit >> 3] >> (7 - (bit & 7))) & 1) ? AUDIO_VOLUME : -AUDIO_VOLUME;
+
+        phase += step;
+
+        if(phase >= 128)
+            phase -= 128;
+    }
+}
+
+//Sound of many emulators at once, one second of audio each
+static void benchAudio(uint32_t instances) {
+
+    cout << "Audio (" << instances << " emulators, " << AUDIO_BENCH_RATE << " Hz, million samples per second) :" << endl;
+
+    vector<Chip8> chip8s(instances);
+    vector<Audio> audios(instances, Audio(AUDIO_BENCH_RATE));
+    vector<double> phases(instances);
+    vector<int16_t> out(AUDIO_BENCH_RATE / AUDIO_FRAME_RATE + 1);
+
+    //A steady pattern must settle to a steady level
+    Chip8 &steady = chip8s[0];
+    Audio check(AUDIO_BENCH_RATE);
+
+    steady.soundTimer = 1;
+    steady.audioPattern = true;
+    memset(steady.audioBuffer, 0xFF, sizeof(steady.audioBuffer));
+    check.render(&steady, out.data(), out.size());
+
+    if(out.back() != AUDIO_VOLUME)
+        cout << "  wrong level : " << out.back() << endl;
+
+    //Random patterns, from a low pitch to the highest one
+    const uint8_t pitches[] = {0, 64, 160, 255};
+
+    srand(4);
+
+    for(uint8_t pitch : pitches) {
+        for(Chip8 &chip8 : chip8s) {
+            for(uint8_t &b : chip8.audioBuffer)
+                b = rand();
+
+            chip8.soundTimer = 1;
+            chip8.audioPattern = true;
+            chip8.pitch = pitch;
+        }
+
+        uint32_t frames = AUDIO_FRAME_RATE;
+        double samples = (double)AUDIO_BENCH_RATE * instances;
+
+        double naive = timeCalls(frames, [&] {
+            for(uint32_t i = 0 ; i < instances ; i++)
+                naiveRender(&chip8s[i], phases[i], out.data(), AUDIO_BENCH_RATE / AUDIO_FRAME_RATE);
+        });
+
+        double limited = timeCalls(frames, [&] {
+            for(uint32_t i = 0 ; i < instances ; i++)
+                audios[i].render(&chip8s[i], out.data(), audios[i].frameSamples());
+        });
+
+        cout << "  pitch " << setw(3) << left << (int)pitch << right << fixed << setprecision(1)
+             << setw(10) << samples / (naive * frames) * 1000 << " naive" << setw(10) << samples / (limited * frames) * 1000 << " band-limited" << endl;
+    }
+}
+
+int main(int argc, char **argv) {
+
+    uint32_t n = 1000000;
+
+    if(argc > 1 && sscanf(argv[1], "%u", &n) != 1) {
+        cout << "usage: ch8bench [iterations]" << endl;
+        return 1;
+    }
+
+    benchScroll(n);
+    benchCompose(n / 10);
+    benchScale(n / 100);
+    benchAudio(n / 10000);
+
+    return 0;
+}
@@ -0,0 +1,374 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cfg.hpp"
+#include "nlohmann/json.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+using json = nlohmann::json;
+
+//Last address an instruction can start at, double-length instructions included
+#define CFG_LAST_ADDRESS 0xFFFA
+
+static const char *exitNames[] = {"fallthrough", "jump", "call", "return", "indirect", "skip", "stop"};
+
+//How an instruction ends a block, CFG_EXIT_FALLTHROUGH if it doesn't
+static uint8_t exitType(uint8_t op) {
+    switch(op) {
+        case OP_1NNN: return CFG_EXIT_JUMP;
+        case OP_2NNN: return CFG_EXIT_CALL;
+        case OP_00EE: return CFG_EXIT_RETURN;
+        case OP_BNNN: return CFG_EXIT_INDIRECT;
+
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_9XY0:
+        case OP_EX9E:
+        case OP_EXA1:
+            return CFG_EXIT_SKIP;
+
+        case OP_00FD:
+        case OP_UNKNOWN:
+            return CFG_EXIT_STOP;
+
+        default:
+            return CFG_EXIT_FALLTHROUGH;
+    }
+}
+
+//Hexadecimal address or opcode
+static std::string hex(uint32_t value, uint8_t width) {
+    std::stringstream ss;
+    ss << std::hex << std::uppercase << std::setfill('0') << std::setw(width) << value;
+
+    return ss.str();
+}
+
+Cfg::Cfg(Chip8 *c) {
+    chip8 = c;
+
+    memset(map, CFG_UNKNOWN, sizeof(map));
+    memset(visited, false, sizeof(visited));
+}
+
+//Instruction length, decoding it if needed
+uint8_t Cfg::length(uint16_t addr) {
+    if(chip8->cache[addr].handler == nullptr)
+        chip8->decode(addr);
+
+    return (chip8->cache[addr].op == OP_F000) ? 4 : 2;
+}
+
+//Address reached when a skip at addr skips
+//Skips jump over both words of F000 NNNN
+uint16_t Cfg::skipTarget(uint16_t addr) {
+    uint16_t next = addr + 2;
+
+    if(((chip8->memory[next] << 8) | chip8->memory[next + 1]) == 0xF000)
+        return addr + 6;
+
+    return addr + 4;
+}
+
+//Recover the control-flow graph of the code reachable from entry
+void Cfg::build(uint16_t start) {
+
+    entry = start;
+
+    blocks.clear();
+    functions.clear();
+    dataRefs.clear();
+    indirect = false;
+
+    memset(map, CFG_UNKNOWN, sizeof(map));
+    memset(visited, false, sizeof(visited));
+
+    std::set<uint16_t> leaders;
+    std::vector<uint16_t> work;
+
+    leaders.insert(entry);
+    functions.insert(entry);
+    work.push_back(entry);
+
+    //Find reachable instructions and block leaders
+    while(!work.empty()) {
+
+        uint32_t addr = work.back();
+        work.pop_back();
+
+        while(addr <= CFG_LAST_ADDRESS && !visited[addr]) {
+
+            visited[addr] = true;
+
+            uint8_t len = length(addr);
+            const Instruction &inst = chip8->cache[addr];
+
+            for(uint8_t i = 0 ; i < len ; i++)
+                map[addr + i] = CFG_CODE;
+
+            if(inst.op == OP_ANNN || inst.op == OP_F000)
+                dataRefs.insert(inst.nnn);
+
+            uint8_t exit = exitType(inst.op);
+
+            if(exit == CFG_EXIT_FALLTHROUGH) {
+                addr += len;
+                continue;
+            }
+
+            std::vector<uint16_t> targets;
+
+            if(exit == CFG_EXIT_JUMP)
+                targets.push_back(inst.nnn);
+            else if(exit == CFG_EXIT_CALL) {
+                targets.push_back(inst.nnn);
+                targets.push_back(addr + 2);
+                functions.insert(inst.nnn);
+            }
+            else if(exit == CFG_EXIT_SKIP) {
+                targets.push_back(addr + 2);
+                targets.push_back(skipTarget(addr));
+            }
+            else if(exit == CFG_EXIT_INDIRECT)
+                indirect = true;
+
+            for(uint16_t target : targets)
+                if(leaders.insert(target).second)
+                    work.push_back(target);
+
+            break;
+        }
+    }
+
+    //Bytes of the ROM that are never executed
+    for(uint32_t addr = 0x200 ; addr < 0x200 + chip8->romSize && addr < 0x10000 ; addr ++)
+        if(map[addr] != CFG_CODE)
+            map[addr] = CFG_DATA;
+
+    //Split reachable code into blocks
+    for(uint16_t leader : leaders) {
+
+        if(!visited[leader])
+            continue;
+
+        CfgBlock block;
+        block.start = leader;
+
+        uint32_t addr = leader;
+
+        for(;;) {
+            uint32_t next = addr + length(addr);
+
+            block.last = addr;
+            block.end = next;
+            block.exit = exitType(chip8->cache[addr].op);
+
+            if(block.exit != CFG_EXIT_FALLTHROUGH)
+                break;
+
+            //Ran out of memory
+            if(next > CFG_LAST_ADDRESS) {
+                block.exit = CFG_EXIT_STOP;
+                break;
+            }
+
+            if(leaders.count(next) != 0)
+                break;
+
+            addr = next;
+        }
+
+        addEdges(block, block.exit);
+        blocks[leader] = block;
+    }
+
+    for(auto &it : blocks)
+        for(uint16_t successor : it.second.successors)
+            if(blocks.count(successor) != 0)
+                blocks[successor].predecessors.push_back(it.first);
+}
+
+//Fill in the successors of a block from the way it ends
+void Cfg::addEdges(CfgBlock &block, uint8_t exit) {
+
+    const Instruction &inst = chip8->cache[block.last];
+
+    switch(exit) {
+        case CFG_EXIT_FALLTHROUGH:
+            block.successors.push_back(block.end);
+            break;
+
+        case CFG_EXIT_JUMP:
+            block.successors.push_back(inst.nnn);
+            break;
+
+        case CFG_EXIT_CALL:
+            block.successors.push_back(inst.nnn);
+            block.successors.push_back(block.last + 2);
+            break;
+
+        case CFG_EXIT_SKIP:
+            block.successors.push_back(block.last + 2);
+            block.successors.push_back(skipTarget(block.last));
+            break;
+
+        default:
+            break;
+    }
+}
+
+//Block containing an address, nullptr if it's not reachable code
+CfgBlock* Cfg::blockAt(uint16_t addr) {
+
+    auto it = blocks.upper_bound(addr);
+
+    if(it == blocks.begin())
+        return nullptr;
+
+    it --;
+
+    if(addr >= it->second.end)
+        return nullptr;
+
+    return &it->second;
+}
+
+//Export the graph in Graphviz DOT format
+uint8_t Cfg::exportDot(std::string filename) {
+
+    std::ofstream file(filename);
+
+    if(!file) {
+        std::cout << "Could not write file " << filename << std::endl;
+        return 1;
+    }
+
+    file << "digraph cfg {" << std::endl;
+    file << "    node [shape=box fontname=\"monospace\"];" << std::endl;
+
+    for(auto &it : blocks) {
+        CfgBlock &block = it.second;
+
+        file << "    b" << hex(block.start, 4) << " [label=\"";
+
+        for(uint32_t addr = block.start ; addr < block.end ; addr += length(addr)) {
+            file << hex(addr, 4) << ": " << hex(chip8->cache[addr].opcode, 4);
+
+            if(chip8->cache[addr].op == OP_F000)
+                file << " " << hex(chip8->cache[addr].nnn, 4);
+
+            file << "\\l";
+        }
+
+        file << "\"";
+
+        if(functions.count(block.start) != 0)
+            file << " style=bold";
+
+        file << "];" << std::endl;
+
+        for(size_t i = 0 ; i < block.successors.size() ; i++) {
+            file << "    b" << hex(block.start, 4) << " -> b" << hex(block.successors[i], 4);
+
+            //Call edge
+            if(block.exit == CFG_EXIT_CALL && i == 0)
+                file << " [style=dashed]";
+
+            file << ";" << std::endl;
+        }
+    }
+
+    file << "}" << std::endl;
+
+    return 0;
+}
+
+//Export the graph and memory map as JSON
+uint8_t Cfg::exportJson(std::string filename) {
+
+    std::ofstream file(filename);
+
+    if(!file) {
+        std::cout << "Could not write file " << filename << std::endl;
+        return 1;
+    }
+
+    json out;
+
+    out["entry"] = entry;
+    out["indirect"] = indirect;
+    out["functions"] = functions;
+    out["dataRefs"] = dataRefs;
+    out["blocks"] = json::array();
+
+    for(auto &it : blocks) {
+        CfgBlock &block = it.second;
+        json instructions = json::array();
+
+        for(uint32_t addr = block.start ; addr < block.end ; addr += length(addr)) {
+            const Instruction &inst = chip8->cache[addr];
+            uint32_t opcode = inst.opcode;
+
+            if(inst.op == OP_F000)
+                opcode = (opcode << 16) | inst.nnn;
+
+            instructions.push_back({{"address", addr}, {"opcode", hex(opcode, (inst.op == OP_F000) ? 8 : 4)}});
+        }
+
+        out["blocks"].push_back({
+            {"start", block.start},
+            {"end", block.end},
+            {"exit", exitNames[block.exit]},
+            {"successors", block.successors},
+            {"predecessors", block.predecessors},
+            {"instructions", instructions}
+        });
+    }
+
+    //Data ranges, as [start, end)
+    out["data"] = json::array();
+
+    for(uint32_t addr = 0 ; addr < 0x10000 ; addr ++) {
+        if(map[addr] != CFG_DATA)
+            continue;
+
+        uint32_t end = addr;
+
+        while(end < 0x10000 && map[end] == CFG_DATA)
+            end ++;
+
+        out["data"].push_back({addr, end});
+        addr = end;
+    }
+
+    file << out.dump(2) << std::endl;
+
+    return 0;
+}
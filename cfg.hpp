@@ -0,0 +1,104 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef CFG_HPP_INCLUDED
+#define CFG_HPP_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "chip8.hpp"
+
+//Memory map
+#define CFG_UNKNOWN 0   //Outside the ROM and never reached
+#define CFG_CODE 1      //Part of a reachable instruction
+#define CFG_DATA 2      //Inside the ROM but never reached, sprites and tables
+
+//How a basic block ends
+#define CFG_EXIT_FALLTHROUGH 0  //Runs into the next block
+#define CFG_EXIT_JUMP 1         //1NNN
+#define CFG_EXIT_CALL 2         //2NNN, continues after the call
+#define CFG_EXIT_RETURN 3       //00EE
+#define CFG_EXIT_INDIRECT 4     //BNNN, target only known at run time
+#define CFG_EXIT_SKIP 5         //Conditional skip
+#define CFG_EXIT_STOP 6         //00FD, unknown opcode or end of memory
+
+//Basic block
+struct CfgBlock {
+    uint16_t start;                     //Address of the first instruction
+    uint32_t end;                       //Address after the last instruction
+    uint16_t last;                      //Address of the last instruction
+    uint8_t exit;                       //CFG_EXIT_ type
+    std::vector<uint16_t> successors;   //Call target first for CFG_EXIT_CALL
+    std::vector<uint16_t> predecessors;
+};
+
+//Static control-flow graph of the program in memory
+//Follows jumps, calls, skips and double-length instructions from an entry
+//point. Code only reachable through BNNN is not recovered.
+class Cfg {
+
+public:
+
+    Chip8 *chip8;
+
+    //Analysis entry point
+    uint16_t entry = 0x200;
+
+    //Basic blocks, by start address
+    std::map<uint16_t, CfgBlock> blocks;
+
+    //Entry point and call targets
+    std::set<uint16_t> functions;
+
+    //Addresses loaded into I by ANNN and F000 NNNN
+    std::set<uint16_t> dataRefs;
+
+    //CFG_ type of every memory byte
+    uint8_t map[0x10000];
+
+    //Some blocks end with BNNN
+    bool indirect = false;
+
+    Cfg(Chip8*);
+
+    void build(uint16_t entry = 0x200);
+    CfgBlock* blockAt(uint16_t);
+    uint8_t exportDot(std::string);
+    uint8_t exportJson(std::string);
+
+private:
+
+    //Start of a reachable instruction
+    bool visited[0x10000];
+
+    uint8_t length(uint16_t);
+    uint16_t skipTarget(uint16_t);
+    void addEdges(CfgBlock&, uint8_t);
+};
+
+#endif // CFG_HPP_INCLUDED
@@ -23,6 +23,8 @@ SOFTWARE.
 */
 
 #include "chip8.hpp"
+#include "jit.hpp"
+#include "scroll.hpp"
 #include "nlohmann/json.hpp"
 
 #include <sys/types.h>
@@ -54,6 +56,13 @@ Chip8::Chip8() {
     hiresClearQuirk = true;     //Clear screen when changing resolutions
     wrapQuirk = false;          //Sprites do not wrap around by default
 
+    selectQuirks();
+
+    scrollKernels = selectScrollKernels();
+
+    //No breakpoints
+    memset(breakpoints, false, sizeof(breakpoints));
+
     //Default palette
     palette[0][0] = 0x00;
     palette[0][1] = 0x00;
@@ -71,6 +80,10 @@ Chip8::Chip8() {
     initialize();
 };
 
+Chip8::~Chip8() {
+    delete jit;
+}
+
 //Initialize CHIP-8
 void Chip8::initialize() {
     pc = 0x200; //Program counter
@@ -79,19 +92,24 @@ void Chip8::initialize() {
     opcode = 0; //Current opcode
 
     hiRes = false;
+    nativeLores = true;
 
     //Stop flag used by SUPERCHIP
     stopped = false;
+    waiting = false;
+    breakpointHit = false;
 
     //Clear graphics bit planes
-    memset(gfx[0], false, SCHIP_WH);
-    memset(gfx[1], false, SCHIP_WH);
+    clearPlanes(3);
 
     bitPlane = 1;
 
     delayTimer = 0;
     soundTimer = 0;
 
+    audioPattern = false;
+    pitch = 64;
+
     memset(keys, false, 16);
     memset(v, false, 16);
 
@@ -128,6 +146,9 @@ void Chip8::initialize() {
     };
 
     memcpy(memory, fontSet, 180);
+
+    //Memory has changed, drop predecoded instructions
+    flushCache();
 };
 
 //Print unknown opcode error
@@ -315,6 +336,8 @@ uint8_t Chip8::loadROM(std::string filename) {
 
     close(fd);
 
+    flushCache();
+
     if(pos > MAXSIZE) {
         std::cout << "ROM file too large (more than " << std::dec << (int)MAXSIZE << " bytes)" << std::endl;
         return 1;
@@ -323,6 +346,7 @@ uint8_t Chip8::loadROM(std::string filename) {
     std::cout << "Loaded : " << pos << " bytes" << std::endl;
 
     loaded = true;
+    romSize = pos;
 
     //CRC32
     uLong hash = crc32(0, (Bytef *) memory + 0x200, pos);
@@ -405,6 +429,9 @@ uint8_t Chip8::loadROM(std::string filename) {
         std::cout << "Game not found in database" << std::endl;
     }
 
+    //Quirks are final, pick the matching handlers
+    selectQuirks();
+
     return 0;
 
 };
@@ -457,6 +484,22 @@ uint8_t Chip8::checkKeys() {
     return 255;
 };
 
+//Key pressed
+void Chip8::pressKey(uint8_t key) {
+    keys[key & 0xF] = true;
+}
+
+//Key released
+//Unblocks FX0A, which stores the released key
+void Chip8::releaseKey(uint8_t key) {
+    keys[key & 0xF] = false;
+
+    if(waiting) {
+        v[waitRegister] = key & 0xF;
+        waiting = false;
+    }
+}
+
 //Read next byte and increment pc
 uint8_t Chip8::nextByte() {
     uint8_t byte = memory[pc];
@@ -490,730 +533,1517 @@ void Chip8::updateTimers() {
         soundTimer --;
 }
 
+//Lores scrolls move whole screen pixels, that is half as many lores pixels
+//Natively stored lores screens are expanded first when that falls between two pixels
+
 //Scroll left
 void Chip8::scrollLeft(uint8_t pixels) {
 
-    for(uint8_t y0 = 0 ; y0 < SCHIP_H ; y0 ++) {
-        if((bitPlane & 0x1) != 0) {
-            memmove(gfx[0] + y0*SCHIP_W,   gfx[0] + pixels + y0*SCHIP_W,   SCHIP_W - pixels);
-            memset(gfx[0] + SCHIP_W - pixels + y0*SCHIP_W,   false,   pixels);
-        }
+    if(pixels == 0)
+        return;
 
-        if((bitPlane & 0x2) != 0) {
-            memmove(gfx[1] + y0*SCHIP_W,   gfx[1] + pixels + y0*SCHIP_W,   SCHIP_W - pixels);
-            memset(gfx[1] + SCHIP_W - pixels + y0*SCHIP_W,   false,   pixels);
-        }
-    }
+    if(nativeLores && (pixels & 1) != 0)
+        expandLores();
+
+    for(uint8_t plane = 0 ; plane < 2 ; plane ++)
+        if((bitPlane & (plane+1)) != 0)
+            scrollKernels->left(gfx[plane], nativeLores ? pixels / 2 : pixels);
+
+    if((bitPlane & 0x3) != 0)
+        dirtyRows = ~0ull;
 }
 
 //Scroll right
 void Chip8::scrollRight(uint8_t pixels) {
 
-    for(uint8_t y0 = 0 ; y0 < SCHIP_H ; y0 ++) {
-        if((bitPlane & 0x1) != 0) {
-            memmove(gfx[0] + pixels + y0*SCHIP_W,   gfx[0] + y0*SCHIP_W,   SCHIP_W - pixels);
-            memset(gfx[0] + y0*SCHIP_W,   false,   pixels);
-        }
+    if(pixels == 0)
+        return;
+
+    if(nativeLores && (pixels & 1) != 0)
+        expandLores();
+
+    for(uint8_t plane = 0 ; plane < 2 ; plane ++) {
+        if((bitPlane & (plane+1)) != 0) {
+            scrollKernels->right(gfx[plane], nativeLores ? pixels / 2 : pixels);
 
-        if((bitPlane & 0x2) != 0) {
-            memmove(gfx[1] + pixels + y0*SCHIP_W,   gfx[1] + y0*SCHIP_W,   SCHIP_W - pixels);
-            memset(gfx[1] + y0*SCHIP_W,   false,   pixels);
+            //Pixels pushed past the right edge of a lores row
+            if(nativeLores)
+                for(uint8_t y = 0 ; y < CHIP_H ; y ++)
+                    gfx[plane][y][1] = 0;
         }
     }
+
+    if((bitPlane & 0x3) != 0)
+        dirtyRows = ~0ull;
 }
 
 //Scroll down
 void Chip8::scrollDown(uint8_t pixels) {
 
-    if((bitPlane & 0x1) != 0) {
-        memmove(gfx[0] + SCHIP_W * pixels,   gfx[0],   SCHIP_W * (SCHIP_H - pixels));
-        memset(gfx[0],   false,   SCHIP_W * pixels);
-    }
+    if(nativeLores && (pixels & 1) != 0)
+        expandLores();
 
-    if((bitPlane & 0x2) != 0) {
-        memmove(gfx[1] + SCHIP_W * pixels,   gfx[1],   SCHIP_W * (SCHIP_H - pixels));
-        memset(gfx[1],   false,   SCHIP_W * pixels);
+    uint8_t h = nativeLores ? CHIP_H : SCHIP_H;
+
+    if(nativeLores)
+        pixels /= 2;
+
+    for(uint8_t plane = 0 ; plane < 2 ; plane ++) {
+        if((bitPlane & (plane+1)) != 0) {
+            memmove(gfx[plane][pixels],   gfx[plane][0],   sizeof(gfx[plane][0]) * (h - pixels));
+            memset(gfx[plane][0],   0,   sizeof(gfx[plane][0]) * pixels);
+        }
     }
+
+    if((bitPlane & 0x3) != 0)
+        dirtyRows = ~0ull;
 }
 
 //Scroll up
 void Chip8::scrollUp(uint8_t pixels) {
 
-    if((bitPlane & 0x1) != 0) {
-        memmove(gfx[0],   gfx[0] + SCHIP_W * pixels,   SCHIP_W * (SCHIP_H - pixels));
-        memset(gfx[0] + SCHIP_W * (SCHIP_H - pixels),   false,   SCHIP_W * pixels);
-    }
+    if(nativeLores && (pixels & 1) != 0)
+        expandLores();
+
+    uint8_t h = nativeLores ? CHIP_H : SCHIP_H;
 
-    if((bitPlane & 0x2) != 0) {
-        memmove(gfx[1],   gfx[1] + SCHIP_W * pixels,   SCHIP_W * (SCHIP_H - pixels));
-        memset(gfx[1] + SCHIP_W * (SCHIP_H - pixels),   false,   SCHIP_W * pixels);
+    if(nativeLores)
+        pixels /= 2;
+
+    for(uint8_t plane = 0 ; plane < 2 ; plane ++) {
+        if((bitPlane & (plane+1)) != 0) {
+            memmove(gfx[plane][0],   gfx[plane][pixels],   sizeof(gfx[plane][0]) * (h - pixels));
+            memset(gfx[plane][h - pixels],   0,   sizeof(gfx[plane][0]) * pixels);
+        }
     }
+
+    if((bitPlane & 0x3) != 0)
+        dirtyRows = ~0ull;
 }
 
-//Draw pixel to the gfx buffer
-void Chip8::pixel(uint8_t x, uint8_t y, uint8_t sprPlane) {
+//Clear the selected bitplanes
+//An expanded lores screen goes back to native rows once it is blank
+void Chip8::clearPlanes(uint8_t planes) {
+    if((planes & 0x1) != 0)
+        memset(gfx[0], 0, sizeof(gfx[0]));
 
-    for(uint8_t plane = 0 ; plane < 2 ; plane ++) {
+    if((planes & 0x2) != 0)
+        memset(gfx[1], 0, sizeof(gfx[1]));
 
-        //XO-CHIP bitplanes
-        if((sprPlane & (plane+1)) != 0) {
+    if((planes & 0x3) != 0)
+        dirtyRows = ~0ull;
 
-            //Memory location
-            uint16_t addr = x + SCHIP_W * y;
+    if(!hiRes && !nativeLores) {
+        uint64_t lit = 0;
 
-            //Collision flag
-            if(gfx[plane][addr])
-                v[0xF] = 1;
+        for(uint8_t plane = 0 ; plane < 2 ; plane ++)
+            for(uint8_t y = 0 ; y < SCHIP_H ; y ++)
+                lit |= gfx[plane][y][0] | gfx[plane][y][1];
 
-            //VRAM
-            gfx[plane][addr] ^= 1;
+        if(lit == 0)
+            nativeLores = true;
+    }
+}
+
+//Screen rows changed since the last call, one bit per row
+//Drawing, scrolling and clearing mark the rows they touch
+uint64_t Chip8::consumeDirty() {
+    uint64_t rows = dirtyRows;
+    dirtyRows = 0;
+
+    return rows;
+}
+
+//64-bit hash of the screen, for skipping unchanged frames and comparing runs
+//Words are mixed in with a multiply and a shift, in four independent lanes
+//so the multiplies overlap. The layout is part of the seed.
+uint64_t Chip8::screenHash() const {
+    const uint64_t k = 0xFF51AFD7ED558CCDull;
+    const uint64_t *words = &gfx[0][0][0];
+    uint64_t lanes[4] = {0x9E3779B97F4A7C15ull ^ (hiRes ? 1 : 0) ^ (nativeLores ? 2 : 0), 1, 2, 3};
+
+    for(uint32_t i = 0 ; i < sizeof(gfx) / sizeof(uint64_t) ; i += 4) {
+        for(uint32_t l = 0 ; l < 4 ; l ++) {
+            lanes[l] = (lanes[l] ^ words[i + l]) * k;
+            lanes[l] ^= lanes[l] >> 32;
         }
     }
+
+    uint64_t hash = lanes[0];
+
+    for(uint32_t l = 1 ; l < 4 ; l ++) {
+        hash = (hash ^ lanes[l]) * k;
+        hash ^= hash >> 32;
+    }
+
+    return hash;
 }
 
-//Emulate CHIP-8 instruction
-void Chip8::emulateInstruction() {
+//Lores sprite rows expanded to screen pixels, each bit doubled
+static const struct BitDoubler {
+    uint16_t table[256];
 
-    // Waiting for key press
-    if(waiting)
-        pc -= 2;
+    BitDoubler() {
+        for(uint16_t byte = 0 ; byte < 256 ; byte ++) {
+            table[byte] = 0;
 
-    // Read next opcode
-    opcode = nextWord();
+            for(uint8_t bit = 0 ; bit < 8 ; bit ++)
+                if(byte & (1 << bit))
+                    table[byte] |= 3 << (2 * bit);
+        }
+    }
+} doubled;
 
-    // Execute
-    switch(opcode & 0xF000) {
+//Store a native lores screen as 2x2 pixels in the hires layout
+//Rows are expanded from the bottom up, so no row is overwritten before it's read
+void Chip8::expandLores() {
 
-        case 0x0000:{
+    for(uint8_t plane = 0 ; plane < 2 ; plane ++) {
+        for(int8_t y = CHIP_H - 1 ; y >= 0 ; y --) {
+            uint64_t row = gfx[plane][y][0];
+            uint64_t left = 0, right = 0;
 
-            if((opcode & 0x00F0) == 0x00C0) {
-                //0x00CN
-                //(SCHIP) Scroll down by N pixels
-                scrollDown(opcode & 0x000F);
+            for(uint8_t b = 0 ; b < 4 ; b ++) {
+                left |= (uint64_t)doubled.table[(row >> (56 - 8 * b)) & 0xFF] << (48 - 16 * b);
+                right |= (uint64_t)doubled.table[(row >> (24 - 8 * b)) & 0xFF] << (48 - 16 * b);
             }
-            else if ((opcode & 0x00F0) == 0x00D0) {
-                //0x00DN
-                //(XO-CHIP) Scroll up by N pixels
-                scrollUp(opcode & 0x000F);
+
+            for(uint8_t line = 0 ; line < 2 ; line ++) {
+                gfx[plane][2 * y + line][0] = left;
+                gfx[plane][2 * y + line][1] = right;
             }
-            else
-                switch(opcode & 0x00FF) {
-
-                    case 0x00E0: {
-                        //0x00E0
-                        //Clear screen
-                        if((bitPlane & 0x1) != 0)
-                            memset(gfx[0], false, SCHIP_WH);
-
-                        if((bitPlane & 0x2) != 0)
-                            memset(gfx[1], false, SCHIP_WH);
-
-                        break;
-                    }
-
-                    case 0x00EE: {
-                        //0x00EE
-                        //Return
-                        sp --;
-                        pc = stck[sp];
-                        break;
-                    }
-
-                    case 0x00FB: {
-                        //0x00FB
-                        //(SCHIP) Scroll right by 4 pixels
-                        scrollRight(4);
-                        break;
-                    }
-
-                    case 0x00FC: {
-                        //0x00FC
-                        //(SCHIP) Scroll left by 4 pixels
-                        scrollLeft(4);
-                        break;
-                    }
-
-                    case 0x00FD: {
-                        //0x00FD
-                        //(SCHIP) Stop
-                        stopped = true;
-                        pc -= 2;
-                        break;
-                    }
-
-                    case 0x00FE: {
-                        //0x00FE
-                        //(SCHIP) disable hi-res mode
-                        //TODO clears the screen in XO-CHIP
-                        memset(gfx, false, SCHIP_WH * 2);
-
-                        hiRes = false;
-                        break;
-                    }
-
-                    case 0x00FF: {
-                        //0x00FF
-                        //(SCHIP) enable hi-res mode
-                        //TODO clears the screen in XO-CHIP
-                        memset(gfx, false, SCHIP_WH * 2);
-
-                        hiRes = true;
-                        break;
-                    }
-
-                    default: {
-                        //Unknown opcode
-                        unknownOpcode(opcode);
-                        break;
-                    }
+        }
+    }
 
-                }
+    nativeLores = false;
+    dirtyRows = ~0ull;
+}
 
-            break;
-        }
+//Clear the whole instruction cache
+void Chip8::flushCache() {
+    for(uint32_t addr = 0 ; addr < 0x10000 ; addr ++) {
+        cache[addr].handler = nullptr;
+        cache[addr].thread = nullptr;
+    }
+
+    if(jit != nullptr)
+        jit->flush();
+}
+
+//Invalidate cached instructions overlapping a memory write
+void Chip8::invalidate(uint16_t addr, uint16_t len) {
+
+    //Instructions are up to 4 bytes long (F000 NNNN),
+    //so entries starting up to 3 bytes before addr can overlap it
+    for(uint32_t i = 0 ; i < len + 3u ; i ++) {
+        Instruction &inst = cache[(uint16_t)(addr - 3 + i)];
+        inst.handler = nullptr;
+        inst.thread = nullptr;
+    }
+
+    //Translated blocks only cover the bytes they read
+    if(jit != nullptr)
+        jit->invalidate(addr, len);
+
+    if(writeHook != nullptr)
+        writeHook(writeHookData, addr, len);
+}
+
+//Instruction handlers for a quirk set, indexed by OP_ identifier
+template<uint8_t quirks>
+const Chip8::Handler* Chip8::handlerTable() {
+    static const Handler table[OP_COUNT] = {
+        &Chip8::call<&Chip8::opUnknown>,
+        &Chip8::call<&Chip8::opIgnore>,
+        &Chip8::call<&Chip8::op00CN>,
+        &Chip8::call<&Chip8::op00DN>,
+        &Chip8::call<&Chip8::op00E0>,
+        &Chip8::call<&Chip8::op00EE>,
+        &Chip8::call<&Chip8::op00FB>,
+        &Chip8::call<&Chip8::op00FC>,
+        &Chip8::call<&Chip8::op00FD>,
+        &Chip8::call<&Chip8::op00FE>,
+        &Chip8::call<&Chip8::op00FF>,
+        &Chip8::call<&Chip8::op1NNN>,
+        &Chip8::call<&Chip8::op2NNN>,
+        &Chip8::call<&Chip8::op3XNN>,
+        &Chip8::call<&Chip8::op4XNN>,
+        &Chip8::call<&Chip8::op5XY0>,
+        &Chip8::call<&Chip8::op5XY2>,
+        &Chip8::call<&Chip8::op5XY3>,
+        &Chip8::call<&Chip8::op6XNN>,
+        &Chip8::call<&Chip8::op7XNN>,
+        &Chip8::call<&Chip8::op8XY0>,
+        &Chip8::call<&Chip8::op8XY1>,
+        &Chip8::call<&Chip8::op8XY2>,
+        &Chip8::call<&Chip8::op8XY3>,
+        &Chip8::call<&Chip8::op8XY4>,
+        &Chip8::call<&Chip8::op8XY5>,
+        &Chip8::call<&Chip8::op8XY6<quirks>>,
+        &Chip8::call<&Chip8::op8XY7>,
+        &Chip8::call<&Chip8::op8XYE<quirks>>,
+        &Chip8::call<&Chip8::op9XY0>,
+        &Chip8::call<&Chip8::opANNN>,
+        &Chip8::call<&Chip8::opBNNN>,
+        &Chip8::call<&Chip8::opCXNN>,
+        &Chip8::call<&Chip8::opDXYN<quirks>>,
+        &Chip8::call<&Chip8::opEX9E>,
+        &Chip8::call<&Chip8::opEXA1>,
+        &Chip8::call<&Chip8::opF000>,
+        &Chip8::call<&Chip8::opFN01>,
+        &Chip8::call<&Chip8::opF002>,
+        &Chip8::call<&Chip8::opFX07>,
+        &Chip8::call<&Chip8::opFX0A>,
+        &Chip8::call<&Chip8::opFX15>,
+        &Chip8::call<&Chip8::opFX18>,
+        &Chip8::call<&Chip8::opFX1E<quirks>>,
+        &Chip8::call<&Chip8::opFX29>,
+        &Chip8::call<&Chip8::opFX30>,
+        &Chip8::call<&Chip8::opFX33>,
+        &Chip8::call<&Chip8::opFX3A>,
+        &Chip8::call<&Chip8::opFX55<quirks>>,
+        &Chip8::call<&Chip8::opFX65<quirks>>,
+        &Chip8::call<&Chip8::opFX75>,
+        &Chip8::call<&Chip8::opFX85>
+    };
+
+    return table;
+}
+
+//Handler tables for every quirk combination
+static const Chip8::Handler* (*const handlerTables[QUIRK_COMBINATIONS])() = {
+    &Chip8::handlerTable<0>,  &Chip8::handlerTable<1>,  &Chip8::handlerTable<2>,  &Chip8::handlerTable<3>,
+    &Chip8::handlerTable<4>,  &Chip8::handlerTable<5>,  &Chip8::handlerTable<6>,  &Chip8::handlerTable<7>,
+    &Chip8::handlerTable<8>,  &Chip8::handlerTable<9>,  &Chip8::handlerTable<10>, &Chip8::handlerTable<11>,
+    &Chip8::handlerTable<12>, &Chip8::handlerTable<13>, &Chip8::handlerTable<14>, &Chip8::handlerTable<15>
+};
+
+//Superinstruction handlers for a quirk set, indexed by FUSE_ identifier
+template<uint8_t quirks>
+const Chip8::Handler* Chip8::fusedHandlerTable() {
+    static const Handler table[FUSE_COUNT] = {
+        nullptr,
+        &Chip8::call<&Chip8::fuseANNN_DXYN<quirks>>,
+        &Chip8::call<&Chip8::fuse6XNN_FX15>,
+        &Chip8::call<&Chip8::fuse7XNN_3XNN>,
+        &Chip8::call<&Chip8::fuseFX1E_FX65<quirks>>
+    };
 
-        case 0x1000: {
-            //0x1NNN
-            //Jump to location NNN
-            pc = opcode & 0xFFF;
+    return table;
+}
+
+static const Chip8::Handler* (*const fusedHandlerTables[QUIRK_COMBINATIONS])() = {
+    &Chip8::fusedHandlerTable<0>,  &Chip8::fusedHandlerTable<1>,  &Chip8::fusedHandlerTable<2>,  &Chip8::fusedHandlerTable<3>,
+    &Chip8::fusedHandlerTable<4>,  &Chip8::fusedHandlerTable<5>,  &Chip8::fusedHandlerTable<6>,  &Chip8::fusedHandlerTable<7>,
+    &Chip8::fusedHandlerTable<8>,  &Chip8::fusedHandlerTable<9>,  &Chip8::fusedHandlerTable<10>, &Chip8::fusedHandlerTable<11>,
+    &Chip8::fusedHandlerTable<12>, &Chip8::fusedHandlerTable<13>, &Chip8::fusedHandlerTable<14>, &Chip8::fusedHandlerTable<15>
+};
+
+//Set quirk flags from a quirk set
+void Chip8::setQuirks(uint8_t quirks) {
+    loadStoreQuirk = (quirks & QUIRK_LOADSTORE) != 0;
+    shiftQuirk = (quirks & QUIRK_SHIFT) != 0;
+    hiresClearQuirk = (quirks & QUIRK_HIRESCLEAR) != 0;
+    wrapQuirk = (quirks & QUIRK_WRAP) != 0;
+}
+
+//Current quirk flags as a quirk set
+uint8_t Chip8::getQuirks() {
+    return (loadStoreQuirk ? QUIRK_LOADSTORE : 0)
+        | (shiftQuirk ? QUIRK_SHIFT : 0)
+        | (hiresClearQuirk ? QUIRK_HIRESCLEAR : 0)
+        | (wrapQuirk ? QUIRK_WRAP : 0);
+}
+
+//Use the handlers specialized for the current quirk flags
+//Must be called again whenever the flags change
+void Chip8::selectQuirks() {
+    handlers = handlerTables[getQuirks()]();
+    fusedHandlers = fusedHandlerTables[getQuirks()]();
+    flushCache();
+}
+
+
+//Decode instruction at addr into the instruction cache
+void Chip8::decode(uint16_t addr) {
+
+    Instruction &inst = cache[addr];
+
+    uint16_t op = (memory[addr] << 8) | memory[(uint16_t)(addr + 1)];
+
+    inst.opcode = op;
+    inst.x = (op & 0x0F00) >> 8;
+    inst.y = (op & 0x00F0) >> 4;
+    inst.n = op & 0x000F;
+    inst.nn = op & 0x00FF;
+    inst.nnn = op & 0x0FFF;
+
+    uint8_t id = OP_UNKNOWN;
+
+    switch(op & 0xF000) {
+
+        case 0x0000: {
+            if((op & 0x00F0) == 0x00C0)
+                id = OP_00CN;
+            else if((op & 0x00F0) == 0x00D0)
+                id = OP_00DN;
+            else switch(op & 0x00FF) {
+                case 0x00E0: id = OP_00E0; break;
+                case 0x00EE: id = OP_00EE; break;
+                case 0x00FB: id = OP_00FB; break;
+                case 0x00FC: id = OP_00FC; break;
+                case 0x00FD: id = OP_00FD; break;
+                case 0x00FE: id = OP_00FE; break;
+                case 0x00FF: id = OP_00FF; break;
+                default: break;
+            }
             break;
         }
 
-        case 0x2000: {
-            //0x2NNN
-            //Call location NNN
-            stck[sp] = pc;
-            sp ++;
-            pc = (opcode & 0xFFF);
+        case 0x1000: id = OP_1NNN; break;
+        case 0x2000: id = OP_2NNN; break;
+        case 0x3000: id = OP_3XNN; break;
+        case 0x4000: id = OP_4XNN; break;
+
+        case 0x5000: {
+            switch(op & 0x000F) {
+                case 0x0000: id = OP_5XY0; break;
+                case 0x0002: id = OP_5XY2; break;
+                case 0x0003: id = OP_5XY3; break;
+                default: id = OP_IGNORE; break;
+            }
             break;
         }
 
-        case 0x3000: {
-            //0x3XNN
-            //Skip next instruction if VX == NN
-            if((opcode & 0x00FF) == v[(opcode & 0x0F00) >> 8])
-                skipNextInstruction();
+        case 0x6000: id = OP_6XNN; break;
+        case 0x7000: id = OP_7XNN; break;
 
+        case 0x8000: {
+            switch(op & 0x000F) {
+                case 0x0000: id = OP_8XY0; break;
+                case 0x0001: id = OP_8XY1; break;
+                case 0x0002: id = OP_8XY2; break;
+                case 0x0003: id = OP_8XY3; break;
+                case 0x0004: id = OP_8XY4; break;
+                case 0x0005: id = OP_8XY5; break;
+                case 0x0006: id = OP_8XY6; break;
+                case 0x0007: id = OP_8XY7; break;
+                case 0x000E: id = OP_8XYE; break;
+                default: break;
+            }
             break;
         }
 
-        case 0x4000: {
-            //0x4XNN
-            //Skip next instruction if VX != NN
-            if((opcode & 0x00FF) != v[(opcode & 0x0F00) >> 8])
-                skipNextInstruction();
+        case 0x9000: id = OP_9XY0; break;
+        case 0xA000: id = OP_ANNN; break;
+        case 0xB000: id = OP_BNNN; break;
+        case 0xC000: id = OP_CXNN; break;
+        case 0xD000: id = OP_DXYN; break;
 
+        case 0xE000: {
+            switch(op & 0x00FF) {
+                case 0x009E: id = OP_EX9E; break;
+                case 0x00A1: id = OP_EXA1; break;
+                default: break;
+            }
             break;
         }
 
-        case 0x5000: {
-
-            switch(opcode & 0x000F) {
-                
+        case 0xF000: {
+            switch(op & 0x00FF) {
                 case 0x0000: {
-                    //0x5XY0
-                    //Skip next instruction if VX == VY
-                    if(v[(opcode & 0x0F00) >> 8] == v[(opcode & 0x00F0) >> 4])
-                        skipNextInstruction();
-                    break;
-                }
+                    //Double-length instruction, NNNN is the next word
+                    id = OP_F000;
+                    inst.nnn = (memory[(uint16_t)(addr + 2)] << 8) | memory[(uint16_t)(addr + 3)];
+                    break;
+                }
+                case 0x0001: id = OP_FN01; break;
+                case 0x0002: id = OP_F002; break;
+                case 0x0007: id = OP_FX07; break;
+                case 0x000A: id = OP_FX0A; break;
+                case 0x0015: id = OP_FX15; break;
+                case 0x0018: id = OP_FX18; break;
+                case 0x001E: id = OP_FX1E; break;
+                case 0x0029: id = OP_FX29; break;
+                case 0x0030: id = OP_FX30; break;
+                case 0x0033: id = OP_FX33; break;
+                case 0x003A: id = OP_FX3A; break;
+                case 0x0055: id = OP_FX55; break;
+                case 0x0065: id = OP_FX65; break;
+                case 0x0075: id = OP_FX75; break;
+                case 0x0085: id = OP_FX85; break;
+                default: break;
+            }
+            break;
+        }
 
-                case 0x0002: {
-                    //0x5XY2
-                    //(XO-CHIP) Save VX..VY to memory at location I
-                    uint8_t x = ((opcode & 0x0F00) >> 8);
-                    uint8_t y = ((opcode & 0x00F0) >> 4);
+        default: break;
+    }
 
-                    if(y >= x)
-                        memcpy(memory + I, v + x, 1 + y - x);
-                    else {
-                        //Reverse
-                        for(uint8_t i = 0 ; i <= x - y ; i ++)
-                            memory[I + i] = v[x - i];
-                    }
+    inst.op = id;
+    inst.handler = handlers[id];
+    inst.thread = nullptr;
 
-                    break;
-                }
-
-                case 0x0003: {
-                    //0x5XY3
-                    //(XO-CHIP) Load VX..VY from memory at location I
-                    uint8_t x = ((opcode & 0x0F00) >> 8);
-                    uint8_t y = ((opcode & 0x00F0) >> 4);
+    //Superinstructions
+    //The pair spans 4 bytes like F000 NNNN, so invalidate() drops it
+    //whenever either instruction is overwritten
+    uint16_t next = (memory[(uint16_t)(addr + 2)] << 8) | memory[(uint16_t)(addr + 3)];
 
-                    if(y >= x)
-                        memcpy(v + x, memory + I, 1 + y - x);
-                    else {
-                        //Reverse
-                        for(uint8_t i = 0 ; i <= x - y ; i ++)
-                            v[x - i] = memory[I + i];
-                    }
+    inst.fuse = FUSE_NONE;
 
-                    break;
-                }
+    //Nothing is fused across the end of memory
+    if(addr > 0xFFFC)
+        return;
 
-                default : break;
-            }
+    switch(id) {
+        case OP_ANNN:
+            if((next & 0xF000) == 0xD000)
+                inst.fuse = FUSE_ANNN_DXYN;
+            break;
 
+        case OP_6XNN:
+            if((next & 0xF0FF) == 0xF015)
+                inst.fuse = FUSE_6XNN_FX15;
             break;
-        }
 
-        case 0x6000: {
-            //0x6XNN
-            //Load NN into VX
-            v[(opcode & 0x0F00) >> 8] = opcode & 0x00FF;
+        case OP_7XNN:
+            if((next & 0xF000) == 0x3000)
+                inst.fuse = FUSE_7XNN_3XNN;
             break;
-        }
 
-        case 0x7000: {
-            //0x7XNN
-            //Add NN to VX
-            v[(opcode & 0x0F00) >> 8] += (opcode & 0x00FF);
+        case OP_FX1E:
+            if((next & 0xF0FF) == 0xF065)
+                inst.fuse = FUSE_FX1E_FX65;
             break;
-        }
 
-        case 0x8000: {
-            uint8_t x = (opcode & 0x0F00) >> 8;
-            uint8_t y = (opcode & 0x00F0) >> 4;
+        default: break;
+    }
 
-            switch(opcode & 0x000F) {
+    if(inst.fuse != FUSE_NONE) {
+        inst.opcode2 = next;
+        inst.x2 = (next & 0x0F00) >> 8;
+        inst.y2 = (next & 0x00F0) >> 4;
+        inst.n2 = next & 0x000F;
+        inst.nn2 = next & 0x00FF;
+    }
+}
 
-                case 0x0000: {
-                    //0x8XY0
-                    //Set VX = VY
-                    v[x] = v[y];
-                    break;
-                }
+//Emulate CHIP-8 instruction
+void Chip8::emulateInstruction() {
 
-                case 0x0001: {
-                    //0x8XY1
-                    //Set VX = VX OR VY
-                    v[x] |= v[y];
-                    break;
-                }
+    //Stepping over a breakpoint
+    breakpointHit = false;
 
-                case 0x0002: {
-                    //0x8XY2
-                    //Set VX = VX AND VY
-                    v[x] &= v[y];
-                    break;
-                }
+    //Blocked by FX0A until a key is released
+    if(waiting)
+        return;
 
-                case 0x0003: {
-                    //0x8XY3
-                    //Set VX = VX XOR VY
-                    v[x] ^= v[y];
-                    break;
-                }
+    // Fetch predecoded instruction
+    Instruction &inst = cache[pc];
 
-                case 0x0004: {
-                    //0x8XY4
-                    //Set VX = VX + VY
-                    //Set VF = carry
-                    uint8_t carry = ((v[x] + v[y]) > 0xFF) ? 1 : 0;
-                    v[x] += v[y];
-                    v[0xF] = carry;
-                    break;
-                }
+    if(inst.handler == nullptr)
+        decode(pc);
 
-                case 0x0005: {
-                    //0x8XY5
-                    //Set VX = VX - VY
-                    //Set VF = carry
-                    uint8_t carry = (v[y] > v[x]) ? 0 : 1;
-                    v[x] -= v[y];
-                    v[0xF] = carry;
-                    break;
-                }
+    opcode = inst.opcode;
+    pc += 2;
+
+    // Execute
+    inst.handler(*this, inst);
+}
 
-                case 0x0006: {
-                    //0x8XY6
-                    //Shift VY right, store result in VX
-                    //Set VF = least significant bit of VY
+//Emulate a number of instructions with the selected interpreter core
+//Unknown opcodes and breakpoints don't interrupt the budget
+void Chip8::emulateCycles(uint32_t cycles) {
 
-                    //(SCHIP) Shift VX right
-                    //Set VF = least significant bit of VX
+    while(cycles > 0) {
+        StopReason reason = run(cycles);
 
-                    if(shiftQuirk)
-                        y = x;
-                    
-                    uint8_t carry = v[y] & 0x01;
-                    v[x] = v[y] >> 1;
-                    v[0xF] = carry;
+        //The rest of the budget would not change anything
+        if(reason == STOP_HALT || reason == STOP_KEYWAIT)
+            return;
 
-                    break;
-                }
+        cycles = cyclesLeft;
+    }
+}
 
-                case 0x0007: {
-                    //0x8XY7
-                    //Set VX = VY - VX
-                    //Set VF = Not borrow
-                    uint8_t carry = (v[x] > v[y]) ? 0 : 1;
-                    v[x] = v[y] - v[x];
-                    v[0xF] = carry;
+//Run up to cycles instructions with the selected interpreter core
+//Returns early when the interpreter stops, waits for a key, reaches a
+//breakpoint or executes an unknown opcode. The unused part of the budget
+//is left in cyclesLeft, so the caller can resume where it stopped.
+StopReason Chip8::run(uint32_t cycles) {
 
-                    break;
-                }
+    cyclesLeft = cycles;
 
-                case 0x000E: {
-                    //0x8XYE
-                    //Shift VY left, store result in VX
-                    //Set VF = most significant bit of VY
+    //Timers and keys may have changed since the last run
+    idleArmed = false;
 
-                    //(SCHIP) Shift VX left
-                    //Set VF = most significant bit of VX
+    if(stopped)
+        return STOP_HALT;
 
-                    if(shiftQuirk)
-                        y = x;
+    if(waiting)
+        return STOP_KEYWAIT;
 
-                    uint8_t carry = v[y] >> 7;
-                    v[x] = v[y] << 1;
-                    v[0xF] = carry;
+    if(cycles == 0)
+        return STOP_BUDGET;
 
-                    break;
-                }
+    //Breakpoints are only checked by the cached core
+    if(breakpointCount > 0)
+        return runCached<true>(cycles);
 
-                default: {
-                    //Unknown opcode
-                    unknownOpcode(opcode);
-                    break;
-                }
+    if(core == CORE_THREADED)
+        return emulateThreaded(cycles);
+
+    if(core == CORE_JIT) {
+        if(jit == nullptr)
+            jit = new Jit(this);
 
+        return jit->run(cycles);
+    }
+
+    return runCached<false>(cycles);
+}
+
+//Cached interpreter loop
+//In debug mode, stops before executing an instruction at a breakpoint,
+//except for the one it stopped at last time
+template<bool debug>
+StopReason Chip8::runCached(uint32_t cycles) {
+
+    for(;;) {
+
+        if(debug) {
+            if(breakpoints[pc] && !breakpointHit) {
+                breakpointHit = true;
+                cyclesLeft = cycles;
+                return STOP_BREAKPOINT;
             }
 
-            break;
+            breakpointHit = false;
         }
 
-        case 0x9000: {
-            //0x9XY0
-            //Skip next instruction if VX != VY
-            if(v[(opcode & 0x0F00) >> 8] != v[(opcode & 0x00F0) >> 4])
-                skipNextInstruction();
-            break;
-        }
+        uint16_t addr = pc;
+        Instruction &inst = cache[addr];
 
-        case 0xA000: {
-            //0xANNN
-            //Set I = NNN
-            I = (opcode & 0xFFF);
-            break;
+        if(inst.handler == nullptr)
+            decode(addr);
+
+        //Superinstruction, both instructions at once
+        //A breakpoint could be set on the second one
+        if(!debug && inst.fuse != FUSE_NONE && cycles >= 2) {
+            fuseHits[inst.fuse] ++;
+
+            opcode = inst.opcode2;
+            pc += 4;
+
+            fusedHandlers[inst.fuse](*this, inst);
+            cycles -= 2;
+
+            if(cycles == 0) {
+                cyclesLeft = 0;
+                return STOP_BUDGET;
+            }
+
+            continue;
         }
 
-        case 0xB000: {
-            //0xBNNN
-            //Jump to address NNN + V0
-            pc = ((opcode & 0xFFF) + v[0]);
-            break;
+        //The handler may invalidate its own cache entry
+        uint8_t op = inst.op;
+
+        opcode = inst.opcode;
+        pc += 2;
+
+        inst.handler(*this, inst);
+        cycles --;
+
+        if(op == OP_UNKNOWN || op == OP_00FD || op == OP_FX0A) {
+            cyclesLeft = cycles;
+
+            if(op == OP_UNKNOWN)
+                return STOP_UNKNOWN;
+
+            return (op == OP_00FD) ? STOP_HALT : STOP_KEYWAIT;
         }
 
-        case 0xC000: {
-            //0xCXNN
-            //Set VX = Random (0 -> 255) AND NN
-            v[(opcode & 0x0F00) >> 8] = opcode & (rand() & 0xFF);
-            break;
+        //Skipping idle loops would step over breakpoints
+        if(!debug && op == OP_1NNN && (uint16_t)(addr - pc) < IDLE_MAX_SPAN && cycles > 0)
+            cycles -= idleSkip(addr, cycles);
+
+        if(cycles == 0) {
+            cyclesLeft = 0;
+            return STOP_BUDGET;
         }
+    }
+}
 
-        case 0xD000: {
-            //0xDXYN
-            //Draw sprite
+//Instructions that can be part of an idle loop
+//They only read the machine state, and only write V registers, I and pc
+static bool idleSafe(uint8_t op) {
+    switch(op) {
+        case OP_IGNORE:
+        case OP_1NNN:
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_5XY3:
+        case OP_6XNN:
+        case OP_7XNN:
+        case OP_8XY0:
+        case OP_8XY1:
+        case OP_8XY2:
+        case OP_8XY3:
+        case OP_8XY4:
+        case OP_8XY5:
+        case OP_8XY6:
+        case OP_8XY7:
+        case OP_8XYE:
+        case OP_9XY0:
+        case OP_ANNN:
+        case OP_EX9E:
+        case OP_EXA1:
+        case OP_FX07:
+        case OP_FX1E:
+        case OP_FX29:
+        case OP_FX30:
+        case OP_FX65:
+            return true;
+
+        default:
+            return false;
+    }
+}
 
-            //Dot size on screen
-            uint8_t pSize = hiRes ? 1 : 2;
+//Idle loop detection, called after a short backward jump
+//Within a run, timers and keys don't change. If V and I are the same on
+//two arrivals at the jump, one more iteration is run while checking that
+//it only uses idle-safe instructions and leads back to the same state.
+//Every following iteration would then be identical, so whole iterations
+//are skipped without changing the result.
+//Returns the number of instructions run or skipped, out of the left budget.
+uint32_t Chip8::idleSkip(uint16_t jump, uint32_t left) {
+
+    if(!idleArmed || idleJump != jump || idleI != I || memcmp(idleV, v, 16) != 0) {
+        idleArmed = true;
+        idleJump = jump;
+        idleI = I;
+        memcpy(idleV, v, 16);
+
+        return 0;
+    }
 
-            //Opcode parameters
-            uint8_t x = v[(opcode & 0x0F00) >> 8];
-            uint8_t y = v[(opcode & 0x00F0) >> 4];
-            uint8_t n = opcode & 0x000F;
+    idleArmed = false;
 
-            //Pixel coordinates
-            uint8_t x0, y0;
+    //Checked iteration
+    uint32_t period = 0;
 
-            //Bit mask
-            uint16_t mask;
+    while(period < left && period < IDLE_MAX_SPAN) {
 
-            //Collision flag
-            v[0xF] = 0;
+        uint16_t addr = pc;
+        Instruction &inst = cache[addr];
 
-            uint8_t dX, dY;
+        if(inst.handler == nullptr)
+            decode(addr);
 
-            uint8_t height, memHeight;
-            uint8_t sprPlane = bitPlane;
+        if(!idleSafe(inst.op))
+            return period;
 
-            //Octo quirk : DXY0 draws 16x16 sprite even in loRes mode
-            if(n == 0) {
+        opcode = inst.opcode;
+        pc += 2;
+        inst.handler(*this, inst);
+        period ++;
 
-                //16x16 sprite
-                height = 16;
-                memHeight = 16;
+        if(addr == jump)
+            break;
+    }
 
-                //XO-CHIP multicolor sprite
-                if(bitPlane == 3) {
-                    memHeight = 32;
-                    sprPlane = 1;
-                }
+    if(pc != cache[jump].nnn || idleI != I || memcmp(idleV, v, 16) != 0)
+        return period;
 
-                for(dY = 0 ; dY < memHeight ; dY ++) {
+    uint32_t skip = (left - period) - (left - period) % period;
 
-                    y0 = ((y + (dY % height)) * pSize) % SCHIP_H;
+    if(skip > 0) {
+        idleLoops ++;
+        idleInstructions += skip;
+    }
 
-                    //Multicolor sprites
-                    if(dY >= height)
-                        sprPlane = 2;
+    return period + skip;
+}
 
-                    for(dX = 0 ; dX < 16 ; dX ++) {
+//Set or clear a breakpoint
+void Chip8::setBreakpoint(uint16_t addr, bool set) {
+    if(breakpoints[addr] != set) {
+        breakpoints[addr] = set;
 
-                        mask = 0x8000 >> dX;
-                        x0 = ((x + dX) * pSize) % SCHIP_W;
+        if(set)
+            breakpointCount ++;
+        else
+            breakpointCount --;
+    }
+}
 
-                        //Sprites don't wrap around the screen in XOCHIP mode
-                        if(wrapQuirk || (((x + dX) * pSize < SCHIP_W) && (((y + (dY % height)) * pSize < SCHIP_H)))) {
+//GCC and Clang support computed goto (labels as values)
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(NO_THREADED_GOTO)
+#define THREADED_GOTO
+#endif
+
+//Threaded interpreter core
+//Each instruction body ends with its own dispatch, so that every opcode
+//gets a separate indirect branch instead of sharing the switch's one.
+//Shares the instruction cache and the whole machine state with emulateInstruction.
+//Called by run(), which handles the blocked and empty budget cases.
+StopReason Chip8::emulateThreaded(uint32_t cycles) {
+
+    Instruction *inst;
+
+#ifdef THREADED_GOTO
+    //Dispatch targets, indexed by OP_ identifier
+    //Opcodes without an inlined body go through their handler
+    const void *labels[OP_COUNT];
+
+    for(uint8_t i = 0 ; i < OP_COUNT ; i++)
+        labels[i] = &&L_HANDLER;
+
+    labels[OP_UNKNOWN] = &&L_UNKNOWN;
+    labels[OP_00EE] = &&L_00EE;
+    labels[OP_00FD] = &&L_STOP;
+    labels[OP_1NNN] = &&L_1NNN;
+    labels[OP_2NNN] = &&L_2NNN;
+    labels[OP_3XNN] = &&L_3XNN;
+    labels[OP_4XNN] = &&L_4XNN;
+    labels[OP_5XY0] = &&L_5XY0;
+    labels[OP_6XNN] = &&L_6XNN;
+    labels[OP_7XNN] = &&L_7XNN;
+    labels[OP_8XY0] = &&L_8XY0;
+    labels[OP_8XY1] = &&L_8XY1;
+    labels[OP_8XY2] = &&L_8XY2;
+    labels[OP_8XY3] = &&L_8XY3;
+    labels[OP_9XY0] = &&L_9XY0;
+    labels[OP_ANNN] = &&L_ANNN;
+    labels[OP_FX07] = &&L_FX07;
+    labels[OP_FX0A] = &&L_STOP;
+    labels[OP_FX15] = &&L_FX15;
+
+    //Fetch the next instruction, filling its dispatch target on first use
+    #define FETCH() \
+        inst = &cache[pc]; \
+        if(inst->thread == nullptr) { \
+            if(inst->handler == nullptr) \
+                decode(pc); \
+            inst->thread = (inst->fuse != FUSE_NONE) ? &&L_FUSED : labels[inst->op]; \
+        } \
+        opcode = inst->opcode; \
+        pc += 2;
 
-                            if(((memory[I + 2*dY] << 8 | memory[I + 2*dY + 1]) & mask) != 0) {
+    #define CASE(label) L_##label:
+    #define NEXT() if(--cycles == 0) { cyclesLeft = 0; return STOP_BUDGET; } FETCH(); goto *inst->thread;
+
+    FETCH();
+    goto *inst->thread;
+    {
+#else
+    //Portable table dispatch
+    #define FETCH() \
+        inst = &cache[pc]; \
+        if(inst->handler == nullptr) \
+            decode(pc); \
+        opcode = inst->opcode; \
+        pc += 2;
 
-                                pixel(x0, y0, sprPlane);
+    #define CASE(label) case OP_##label:
+    #define NEXT() if(--cycles == 0) { cyclesLeft = 0; return STOP_BUDGET; } continue;
 
-                                if(!hiRes) {
-                                    pixel(x0 + 1, y0, sprPlane);
-                                    pixel(x0, y0 + 1, sprPlane);
-                                    pixel(x0 + 1, y0 + 1, sprPlane);
-                                }
-                            }
-                        }
-                    }
+    for(;;) {
+        FETCH();
 
-                }
+        if(inst->fuse != FUSE_NONE)
+            goto L_FUSED;
 
+        switch(inst->op) {
+#endif
+
+        //Superinstruction, runs alone when only one cycle is left
+        L_FUSED:
+            if(cycles < 2) {
+                inst->handler(*this, *inst);
+                NEXT();
             }
-            else {
-                //Regular sprite drawing
 
-                height = n;
-                memHeight = n;
+            fuseHits[inst->fuse] ++;
+            opcode = inst->opcode2;
+            pc += 2;
+            fusedHandlers[inst->fuse](*this, *inst);
+            cycles --;
+            NEXT();
+
+#ifdef THREADED_GOTO
+        L_HANDLER:
+#else
+        default:
+#endif
+            inst->handler(*this, *inst);
+            NEXT();
+
+        //FX0A and 00FD block the interpreter until the frontend steps in
+#ifdef THREADED_GOTO
+        L_STOP:
+#else
+        case OP_00FD:
+        case OP_FX0A:
+#endif
+            inst->handler(*this, *inst);
+            cyclesLeft = cycles - 1;
+            return stopped ? STOP_HALT : STOP_KEYWAIT;
+
+        CASE(UNKNOWN)
+            inst->handler(*this, *inst);
+            cyclesLeft = cycles - 1;
+            return STOP_UNKNOWN;
+
+        CASE(00EE)
+            sp --;
+            pc = stck[sp];
+            NEXT();
+
+        CASE(1NNN)
+            pc = inst->nnn;
+
+            //Backward jump, the instruction's address is its cache index
+            if((uint16_t)((inst - cache) - pc) < IDLE_MAX_SPAN && cycles > 1)
+                cycles -= idleSkip(inst - cache, cycles - 1);
+            NEXT();
+
+        CASE(2NNN)
+            stck[sp] = pc;
+            sp ++;
+            pc = inst->nnn;
+            NEXT();
 
-                if(bitPlane == 3) {
-                    memHeight = n * 2;
-                    sprPlane = 1;
-                }
+        CASE(3XNN)
+            if(inst->nn == v[inst->x])
+                skipNextInstruction();
+            NEXT();
 
-                //Regular sprite
-                for(dY = 0 ; dY < memHeight ; dY ++) {
+        CASE(4XNN)
+            if(inst->nn != v[inst->x])
+                skipNextInstruction();
+            NEXT();
 
-                    y0 = ((y + (dY % height)) * pSize) % SCHIP_H;
+        CASE(5XY0)
+            if(v[inst->x] == v[inst->y])
+                skipNextInstruction();
+            NEXT();
 
-                    if(dY >= height)
-                        sprPlane = 2;
+        CASE(6XNN)
+            v[inst->x] = inst->nn;
+            NEXT();
 
-                    for(dX = 0 ; dX < 8 ; dX ++) {
+        CASE(7XNN)
+            v[inst->x] += inst->nn;
+            NEXT();
 
-                        mask = 0x80 >> dX;
-                        x0 = ((x + dX) * pSize) % SCHIP_W;
+        CASE(8XY0)
+            v[inst->x] = v[inst->y];
+            NEXT();
 
-                        if(wrapQuirk || (((x + dX) * pSize < SCHIP_W) && (((y + (dY % height)) * pSize < SCHIP_H)))) {
-                            if((memory[I + dY] & mask) != 0) {
+        CASE(8XY1)
+            v[inst->x] |= v[inst->y];
+            NEXT();
 
-                                pixel(x0, y0, sprPlane);
+        CASE(8XY2)
+            v[inst->x] &= v[inst->y];
+            NEXT();
 
-                                if(!hiRes) {
-                                    pixel(x0 + 1, y0, sprPlane);
-                                    pixel(x0, y0 + 1, sprPlane);
-                                    pixel(x0 + 1, y0 + 1, sprPlane);
-                                }
-                            }
-                        }
+        CASE(8XY3)
+            v[inst->x] ^= v[inst->y];
+            NEXT();
 
-                    }
+        CASE(9XY0)
+            if(v[inst->x] != v[inst->y])
+                skipNextInstruction();
+            NEXT();
 
-                }
+        CASE(ANNN)
+            I = inst->nnn;
+            NEXT();
+
+        CASE(FX07)
+            v[inst->x] = delayTimer;
+            NEXT();
+
+        CASE(FX15)
+            delayTimer = v[inst->x];
+            NEXT();
+    }
+
+#ifndef THREADED_GOTO
+    }
+#endif
+
+    #undef FETCH
+    #undef CASE
+    #undef NEXT
+}
+
+//Unknown opcode
+void Chip8::opUnknown(const Instruction &inst) {
+    unknownOpcode(inst.opcode);
+}
+
+//Opcode ignored by the interpreter
+void Chip8::opIgnore(const Instruction &inst) {
+}
+
+//0x00CN
+//(SCHIP) Scroll down by N pixels
+void Chip8::op00CN(const Instruction &inst) {
+    scrollDown(inst.n);
+}
+
+//0x00DN
+//(XO-CHIP) Scroll up by N pixels
+void Chip8::op00DN(const Instruction &inst) {
+    scrollUp(inst.n);
+}
+
+//0x00E0
+//Clear screen
+void Chip8::op00E0(const Instruction &inst) {
+    clearPlanes(bitPlane);
+}
+
+//0x00EE
+//Return
+void Chip8::op00EE(const Instruction &inst) {
+    sp --;
+    pc = stck[sp];
+}
+
+//0x00FB
+//(SCHIP) Scroll right by 4 pixels
+void Chip8::op00FB(const Instruction &inst) {
+    scrollRight(4);
+}
+
+//0x00FC
+//(SCHIP) Scroll left by 4 pixels
+void Chip8::op00FC(const Instruction &inst) {
+    scrollLeft(4);
+}
+
+//0x00FD
+//(SCHIP) Stop
+void Chip8::op00FD(const Instruction &inst) {
+    stopped = true;
+    pc -= 2;
+}
+
+//0x00FE
+//(SCHIP) disable hi-res mode
+//TODO clears the screen in XO-CHIP
+void Chip8::op00FE(const Instruction &inst) {
+    clearPlanes(3);
+
+    hiRes = false;
+    nativeLores = true;
+}
+
+//0x00FF
+//(SCHIP) enable hi-res mode
+//TODO clears the screen in XO-CHIP
+void Chip8::op00FF(const Instruction &inst) {
+    clearPlanes(3);
+
+    hiRes = true;
+    nativeLores = false;
+}
+
+//0x1NNN
+//Jump to location NNN
+void Chip8::op1NNN(const Instruction &inst) {
+    pc = inst.nnn;
+}
+
+//0x2NNN
+//Call location NNN
+void Chip8::op2NNN(const Instruction &inst) {
+    stck[sp] = pc;
+    sp ++;
+    pc = inst.nnn;
+}
+
+//0x3XNN
+//Skip next instruction if VX == NN
+void Chip8::op3XNN(const Instruction &inst) {
+    if(inst.nn == v[inst.x])
+        skipNextInstruction();
+}
+
+//0x4XNN
+//Skip next instruction if VX != NN
+void Chip8::op4XNN(const Instruction &inst) {
+    if(inst.nn != v[inst.x])
+        skipNextInstruction();
+}
+
+//0x5XY0
+//Skip next instruction if VX == VY
+void Chip8::op5XY0(const Instruction &inst) {
+    if(v[inst.x] == v[inst.y])
+        skipNextInstruction();
+}
+
+//0x5XY2
+//(XO-CHIP) Save VX..VY to memory at location I
+void Chip8::op5XY2(const Instruction &inst) {
+    uint8_t x = inst.x;
+    uint8_t y = inst.y;
+
+    if(y >= x) {
+        memcpy(memory + I, v + x, 1 + y - x);
+        invalidate(I, 1 + y - x);
+    }
+    else {
+        //Reverse
+        for(uint8_t i = 0 ; i <= x - y ; i ++)
+            memory[I + i] = v[x - i];
+
+        invalidate(I, 1 + x - y);
+    }
+}
+
+//0x5XY3
+//(XO-CHIP) Load VX..VY from memory at location I
+void Chip8::op5XY3(const Instruction &inst) {
+    uint8_t x = inst.x;
+    uint8_t y = inst.y;
+
+    if(y >= x)
+        memcpy(v + x, memory + I, 1 + y - x);
+    else {
+        //Reverse
+        for(uint8_t i = 0 ; i <= x - y ; i ++)
+            v[x - i] = memory[I + i];
+    }
+}
+
+//0x6XNN
+//Load NN into VX
+void Chip8::op6XNN(const Instruction &inst) {
+    v[inst.x] = inst.nn;
+}
+
+//0x7XNN
+//Add NN to VX
+void Chip8::op7XNN(const Instruction &inst) {
+    v[inst.x] += inst.nn;
+}
+
+//0x8XY0
+//Set VX = VY
+void Chip8::op8XY0(const Instruction &inst) {
+    v[inst.x] = v[inst.y];
+}
+
+//0x8XY1
+//Set VX = VX OR VY
+void Chip8::op8XY1(const Instruction &inst) {
+    v[inst.x] |= v[inst.y];
+}
+
+//0x8XY2
+//Set VX = VX AND VY
+void Chip8::op8XY2(const Instruction &inst) {
+    v[inst.x] &= v[inst.y];
+}
+
+//0x8XY3
+//Set VX = VX XOR VY
+void Chip8::op8XY3(const Instruction &inst) {
+    v[inst.x] ^= v[inst.y];
+}
+
+//0x8XY4
+//Set VX = VX + VY
+//Set VF = carry
+void Chip8::op8XY4(const Instruction &inst) {
+    uint8_t carry = ((v[inst.x] + v[inst.y]) > 0xFF) ? 1 : 0;
+    v[inst.x] += v[inst.y];
+    v[0xF] = carry;
+}
+
+//0x8XY5
+//Set VX = VX - VY
+//Set VF = carry
+void Chip8::op8XY5(const Instruction &inst) {
+    uint8_t carry = (v[inst.y] > v[inst.x]) ? 0 : 1;
+    v[inst.x] -= v[inst.y];
+    v[0xF] = carry;
+}
+
+//0x8XY6
+//Shift VY right, store result in VX
+//Set VF = least significant bit of VY
+
+//(SCHIP) Shift VX right
+//Set VF = least significant bit of VX
+template<uint8_t quirks>
+void Chip8::op8XY6(const Instruction &inst) {
+    uint8_t y = (quirks & QUIRK_SHIFT) ? inst.x : inst.y;
+
+    uint8_t carry = v[y] & 0x01;
+    v[inst.x] = v[y] >> 1;
+    v[0xF] = carry;
+}
+
+//0x8XY7
+//Set VX = VY - VX
+//Set VF = Not borrow
+void Chip8::op8XY7(const Instruction &inst) {
+    uint8_t carry = (v[inst.x] > v[inst.y]) ? 0 : 1;
+    v[inst.x] = v[inst.y] - v[inst.x];
+    v[0xF] = carry;
+}
+
+//0x8XYE
+//Shift VY left, store result in VX
+//Set VF = most significant bit of VY
+
+//(SCHIP) Shift VX left
+//Set VF = most significant bit of VX
+template<uint8_t quirks>
+void Chip8::op8XYE(const Instruction &inst) {
+    uint8_t y = (quirks & QUIRK_SHIFT) ? inst.x : inst.y;
+
+    uint8_t carry = v[y] >> 7;
+    v[inst.x] = v[y] << 1;
+    v[0xF] = carry;
+}
+
+//0x9XY0
+//Skip next instruction if VX != VY
+void Chip8::op9XY0(const Instruction &inst) {
+    if(v[inst.x] != v[inst.y])
+        skipNextInstruction();
+}
+
+//0xANNN
+//Set I = NNN
+void Chip8::opANNN(const Instruction &inst) {
+    I = inst.nnn;
+}
+
+//0xBNNN
+//Jump to address NNN + V0
+void Chip8::opBNNN(const Instruction &inst) {
+    pc = (inst.nnn + v[0]);
+}
+
+//0xCXNN
+//Set VX = Random (0 -> 255) AND NN
+void Chip8::opCXNN(const Instruction &inst) {
+    v[inst.x] = inst.nn & (rand() & 0xFF);
+}
+
+//0xDXYN
+//Draw sprite
+template<uint8_t quirks>
+void Chip8::opDXYN(const Instruction &inst) {
+    drawSprite<quirks>(v[inst.x], v[inst.y], inst.n);
+}
+
+//Draw the N-line sprite at I to (x, y)
+//Each sprite row is placed into a whole row mask, then XORed into the
+//bitplane one word at a time. Sprites never overlap themselves, so a
+//collision is any lit pixel under the mask.
+//Native lores rows are a single word, expanded lores screens draw 2x2 pixels.
+template<uint8_t quirks>
+void Chip8::drawSprite(uint8_t x, uint8_t y, uint8_t n) {
+
+    //Screen size, in sprite pixels
+    uint8_t w = hiRes ? SCHIP_W : CHIP_W;
+    uint8_t h = hiRes ? SCHIP_H : CHIP_H;
 
+    //Octo quirk : DXY0 draws 16x16 sprite even in loRes mode
+    uint8_t height = (n == 0) ? 16 : n;
+    uint8_t width = (n == 0) ? 16 : 8;
+
+    //Collision flag
+    v[0xF] = 0;
+
+    //Sprites don't wrap around the screen in XOCHIP mode
+    if(!(quirks & QUIRK_WRAP) && x >= w)
+        return;
+
+    x %= w;
+
+    //Sprite pixels are doubled on an expanded lores screen
+    bool doubling = !hiRes && !nativeLores;
+
+    //Left edge and width in the planes
+    uint8_t px = doubling ? x * 2 : x;
+    uint8_t pw = doubling ? width * 2 : width;
+
+    uint64_t hit = 0;
+
+    for(uint8_t plane = 0 ; plane < 2 ; plane ++) {
+
+        //XO-CHIP bitplanes
+        if((bitPlane & (plane+1)) == 0)
+            continue;
+
+        //Multicolor sprites store the second plane's rows after the first's
+        uint8_t first = (bitPlane == 3 && plane == 1) ? height : 0;
+
+        for(uint8_t dY = 0 ; dY < height ; dY ++) {
+
+            uint16_t y0 = y + dY;
+
+            if(!(quirks & QUIRK_WRAP) && y0 >= h)
+                break;
+
+            y0 %= h;
+
+            uint16_t addr = I + first + dY;
+            uint32_t bits;
+
+            if(n == 0) {
+                addr = I + 2 * (first + dY);
+                bits = (memory[addr] << 8) | memory[addr + 1];
+
+                if(doubling)
+                    bits = (doubled.table[bits >> 8] << 16) | doubled.table[bits & 0xFF];
             }
+            else {
+                bits = memory[addr];
 
-            break;
-        }
+                if(doubling)
+                    bits = doubled.table[bits];
+            }
 
-        case 0xE000: {
-            uint8_t key = v[(opcode & 0x0F00) >> 8] & 0xF;
-            switch(opcode & 0x00FF) {
+            if(bits == 0)
+                continue;
 
-                case 0x009E: {
-                    //0xEX9E
-                    //Skip next instruction if key VX is pressed
-                    if(keys[key])
-                        skipNextInstruction();
+            //Sprite row at the top of a word, split across the row's two words
+            //Pixels past the right edge wrap around or are clipped
+            uint64_t sprite = (uint64_t)bits << (64 - pw);
+            uint64_t mask0, mask1, spill;
 
-                    break;
-                }
+            if(px < 64) {
+                mask0 = sprite >> px;
+                mask1 = (px > 0) ? sprite << (64 - px) : 0;
+                spill = 0;
+            }
+            else {
+                mask0 = 0;
+                mask1 = sprite >> (px - 64);
+                spill = (px > 64) ? sprite << (128 - px) : 0;
+            }
 
-                case 0x00A1: {
-                    //0xEXA1
-                    //Skip next instruction if key VX is not pressed
-                    if(!keys[key])
-                        skipNextInstruction();
+            //The right edge of a native lores row is the end of its first word
+            if(nativeLores) {
+                spill = mask1;
+                mask1 = 0;
+            }
 
-                    break;
-                }
+            if(quirks & QUIRK_WRAP)
+                mask0 |= spill;
 
-                default: {
-                    //Unknown opcode
-                    unknownOpcode(opcode);
-                    break;
-                }
+            if((mask0 | mask1) == 0)
+                continue;
+
+            for(uint8_t line = 0 ; line < (doubling ? 2 : 1) ; line ++) {
+                uint8_t screenY = (doubling ? y0 * 2 : y0) + line;
+                uint64_t *row = gfx[plane][screenY];
+
+                dirtyRows |= 1ull << screenY;
+
+                hit |= (row[0] & mask0) | (row[1] & mask1);
+
+                row[0] ^= mask0;
+                row[1] ^= mask1;
             }
-            break;
         }
+    }
 
-        case 0xF000: {
-            uint16_t x = (opcode & 0x0F00) >> 8;
-            uint16_t opcodeLast = opcode & 0x00FF;
+    if(hit != 0)
+        v[0xF] = 1;
+}
 
-            switch(opcodeLast) {
+//0xEX9E
+//Skip next instruction if key VX is pressed
+void Chip8::opEX9E(const Instruction &inst) {
+    if(keys[v[inst.x] & 0xF])
+        skipNextInstruction();
+}
 
-                case 0x0000: {
-                    //0xF000 NNNN
-                    //(XO-CHIP) Load NNNN into I
-                    I = nextWord();
-                    break;
-                }
+//0xEXA1
+//Skip next instruction if key VX is not pressed
+void Chip8::opEXA1(const Instruction &inst) {
+    if(!keys[v[inst.x] & 0xF])
+        skipNextInstruction();
+}
 
-                case 0x0001: {
-                    //0xFN01
-                    //(XO-CHIP) bitplane N select
-                    bitPlane = (opcode & 0x0F00) >> 8;
-                    break;
-                }
+//0xF000 NNNN
+//(XO-CHIP) Load NNNN into I
+void Chip8::opF000(const Instruction &inst) {
+    I = inst.nnn;
+    pc += 2;
+}
 
-                case 0x0002: {
-                    //0xF002
-                    //(XO-CHIP) Store to audio buffer
-                    for(uint8_t i = 0 ; i < 16 ; i++)
-                        audioBuffer[i] = memory[I + i];
-                    break;
-                }
+//0xFN01
+//(XO-CHIP) bitplane N select
+void Chip8::opFN01(const Instruction &inst) {
+    bitPlane = inst.x;
+}
 
-                case 0x0007: {
-                    //0xFX07
-                    //Set VX = delay timer
-                    v[x] = delayTimer;
-                    break;
-                }
+//0xF002
+//(XO-CHIP) Store to audio buffer
+void Chip8::opF002(const Instruction &inst) {
+    for(uint8_t i = 0 ; i < 16 ; i++)
+        audioBuffer[i] = memory[I + i];
 
-                case 0x000A: {
-                    //0xFX0A
-                    //Wait for key press then store key into Vx
-                    waiting = true;
-                    waitRegister = x;
-                    break;
-                }
+    audioPattern = true;
+}
 
-                case 0x0015: {
-                    //0xFX15
-                    //Set delay timer = VX
-                    delayTimer = v[x];
-                    break;
-                }
+//0xFX07
+//Set VX = delay timer
+void Chip8::opFX07(const Instruction &inst) {
+    v[inst.x] = delayTimer;
+}
 
-                case 0x0018: {
-                    //0xFX18
-                    //Set sound timer = VX
-                    soundTimer = v[x];
-                    break;
-                }
+//0xFX0A
+//Wait for key press then store key into Vx
+//Blocks the interpreter until releaseKey()
+void Chip8::opFX0A(const Instruction &inst) {
+    waiting = true;
+    waitRegister = inst.x;
+}
 
-                case 0x001E: {
-                    //0xFX1E
-                    //Set I = I + VX                    
-                    uint8_t carry = (I + v[x] > 0xFFF)? 1 : 0;
+//0xFX15
+//Set delay timer = VX
+void Chip8::opFX15(const Instruction &inst) {
+    delayTimer = v[inst.x];
+}
 
-                    I += v[x];
+//0xFX18
+//Set sound timer = VX
+void Chip8::opFX18(const Instruction &inst) {
+    soundTimer = v[inst.x];
+}
 
-                    // SUPERCHIP sets VF to 1 when there is an overflow
-                    // XO-CHIP (OCTO) doesn't 
-                    // Spacefight 2091 requires this to be enabled
-                    // TODO : investigate this, make it a separate quirk
-                    if(shiftQuirk)
-                        v[0xF] = carry;
+//0xFX1E
+//Set I = I + VX
+template<uint8_t quirks>
+void Chip8::opFX1E(const Instruction &inst) {
+    uint8_t carry = (I + v[inst.x] > 0xFFF)? 1 : 0;
 
-                    break;
-                }
+    I += v[inst.x];
 
-                case 0x0029: {
-                    //0xFX29
-                    //Set I to the location of sprite for digit VX
-                    I = (v[x] * 5);
-                    break;
-                }
+    // SUPERCHIP sets VF to 1 when there is an overflow
+    // XO-CHIP (OCTO) doesn't
+    // Spacefight 2091 requires this to be enabled
+    // TODO : investigate this, make it a separate quirk
+    if(quirks & QUIRK_SHIFT)
+        v[0xF] = carry;
+}
 
-                case 0x0030: {
-                    //0xFX30
-                    //(SCHIP) Set I to the location of hi-res sprite for digit VX
-                    I = (80 + v[x] * 10);
-                    break;
-                }
+//0xFX29
+//Set I to the location of sprite for digit VX
+void Chip8::opFX29(const Instruction &inst) {
+    I = (v[inst.x] * 5);
+}
 
-                case 0x0033: {
-                    //0xFX33
-                    //Store BCD representation of VX to I, I+1, I+2
-                    uint8_t n = v[x];
-                    memory[I] = n / 100;
-                    memory[(I + 1) & 0xFFF] = (n / 10) % 10;
-                    memory[(I + 2) & 0xFFF] = (n % 100) % 10;
-                    break;
-                }
+//0xFX30
+//(SCHIP) Set I to the location of hi-res sprite for digit VX
+void Chip8::opFX30(const Instruction &inst) {
+    I = (80 + v[inst.x] * 10);
+}
 
-                case 0x0055: {
-                    //0xFX55
-                    //Store V0..VX into memory at location I
-                    memcpy(memory + I, v, x + 1);
+//0xFX33
+//Store BCD representation of VX to I, I+1, I+2
+void Chip8::opFX33(const Instruction &inst) {
+    uint8_t n = v[inst.x];
+    memory[I] = n / 100;
+    memory[(I + 1) & 0xFFF] = (n / 10) % 10;
+    memory[(I + 2) & 0xFFF] = (n % 100) % 10;
+
+    invalidate(I, 1);
+    invalidate((I + 1) & 0xFFF, 1);
+    invalidate((I + 2) & 0xFFF, 1);
+}
 
-                    if(!loadStoreQuirk)
-                        I += x + 1;
+//0xFX3A
+//(XO-CHIP) Set the audio pitch register to VX
+void Chip8::opFX3A(const Instruction &inst) {
+    pitch = v[inst.x];
+}
 
-                    break;
-                }
+//0xFX55
+//Store V0..VX into memory at location I
+template<uint8_t quirks>
+void Chip8::opFX55(const Instruction &inst) {
+    memcpy(memory + I, v, inst.x + 1);
+    invalidate(I, inst.x + 1);
 
-                case 0x0065: {
-                    //0xFX65
-                    //Store memory at location I into V0..VX
-                    memcpy(v, memory + I, x + 1);
+    if(!(quirks & QUIRK_LOADSTORE))
+        I += inst.x + 1;
+}
 
-                    if(!loadStoreQuirk)
-                        I += x + 1;
+//0xFX65
+//Store memory at location I into V0..VX
+template<uint8_t quirks>
+void Chip8::opFX65(const Instruction &inst) {
+    memcpy(v, memory + I, inst.x + 1);
 
-                    break;
-                }
+    if(!(quirks & QUIRK_LOADSTORE))
+        I += inst.x + 1;
+}
 
-                case 0x0075: {
-                    //0xFX75
-                    //(SCHIP) Store V0..VX into user flags
-                    memcpy(userFlags, v, x + 1);
+//0xFX75
+//(SCHIP) Store V0..VX into user flags
+void Chip8::opFX75(const Instruction &inst) {
+    memcpy(userFlags, v, inst.x + 1);
+}
 
-                    break;
-                }
+//0xFX85
+//(SCHIP) Store user flags into V0..VX
+void Chip8::opFX85(const Instruction &inst) {
+    memcpy(v, userFlags, inst.x + 1);
+}
 
-                case 0x0085: {
-                    //0xFX85
-                    //(SCHIP) Store user flags into V0..VX
-                    memcpy(v, userFlags, x + 1);
+//ANNN DXYN
+//Set I = NNN, then draw sprite
+template<uint8_t quirks>
+void Chip8::fuseANNN_DXYN(const Instruction &inst) {
+    I = inst.nnn;
+    drawSprite<quirks>(v[inst.x2], v[inst.y2], inst.n2);
+}
 
-                    break;
-                }
+//6XNN FX15
+//Load NN into VX, then set delay timer
+void Chip8::fuse6XNN_FX15(const Instruction &inst) {
+    v[inst.x] = inst.nn;
+    delayTimer = v[inst.x2];
+}
 
-                default : {
-                    //Unknown opcode
-                    unknownOpcode(opcode);
-                    break;
-                }
-            }
-            break;
-        }
+//7XNN 3XNN
+//Add NN to VX, then skip next instruction if VX == NN
+void Chip8::fuse7XNN_3XNN(const Instruction &inst) {
+    v[inst.x] += inst.nn;
 
-        default: {
-            //Unknown opcode
-            unknownOpcode(opcode);
-            break;
-        }
+    if(inst.nn2 == v[inst.x2])
+        skipNextInstruction();
+}
 
-    }
+//FX1E FX65
+//Set I = I + VX, then load V0..VX from memory at I
+template<uint8_t quirks>
+void Chip8::fuseFX1E_FX65(const Instruction &inst) {
+    opFX1E<quirks>(inst);
 
+    memcpy(v, memory + I, inst.x2 + 1);
+
+    if(!(quirks & QUIRK_LOADSTORE))
+        I += inst.x2 + 1;
 }
 
 void Chip8::printInstruction(uint16_t op, uint16_t p) {
@@ -1432,6 +2262,10 @@ void Chip8::printInstruction(uint16_t op, uint16_t p) {
                     std::cout << "LD [I], BCD V" << (int)((op & 0x0F00) >> 8) << std::endl;
                     break;
                 }
+                case 0x3A : {
+                    std::cout << "PITCH V" << (int)((op & 0x0F00) >> 8) << std::endl;
+                    break;
+                }
                 case 0x55 : {
                     std::cout << "LD [I], V0..V" << (int)((op & 0x0F00) >> 8) << std::endl;
                     break;
@@ -36,6 +36,130 @@ SOFTWARE.
 
 #define MAXSIZE 65024
 
+//Interpreter cores
+#define CORE_CACHED 0
+#define CORE_THREADED 1
+#define CORE_JIT 2
+
+//Longest backward jump considered by idle loop detection, in bytes
+//Also bounds the length of a detected loop, in instructions
+#define IDLE_MAX_SPAN 32
+
+//Quirk sets, compile-time parameters of quirk-dependent handlers
+#define QUIRK_LOADSTORE 0x1
+#define QUIRK_SHIFT 0x2
+#define QUIRK_HIRESCLEAR 0x4
+#define QUIRK_WRAP 0x8
+#define QUIRK_COMBINATIONS 16
+
+//Machine quirk profiles
+#define QUIRKS_CHIP8 (QUIRK_HIRESCLEAR | QUIRK_WRAP)
+#define QUIRKS_SCHIP (QUIRK_LOADSTORE | QUIRK_SHIFT | QUIRK_WRAP)
+#define QUIRKS_XOCHIP (QUIRK_HIRESCLEAR)
+#define QUIRKS_SKYWARD (QUIRK_LOADSTORE | QUIRK_HIRESCLEAR)
+
+class Chip8;
+class Jit;
+struct ScrollKernels;
+
+//Instruction identifiers, used to index handler and dispatch tables
+enum {
+    OP_UNKNOWN,
+    OP_IGNORE,
+    OP_00CN,
+    OP_00DN,
+    OP_00E0,
+    OP_00EE,
+    OP_00FB,
+    OP_00FC,
+    OP_00FD,
+    OP_00FE,
+    OP_00FF,
+    OP_1NNN,
+    OP_2NNN,
+    OP_3XNN,
+    OP_4XNN,
+    OP_5XY0,
+    OP_5XY2,
+    OP_5XY3,
+    OP_6XNN,
+    OP_7XNN,
+    OP_8XY0,
+    OP_8XY1,
+    OP_8XY2,
+    OP_8XY3,
+    OP_8XY4,
+    OP_8XY5,
+    OP_8XY6,
+    OP_8XY7,
+    OP_8XYE,
+    OP_9XY0,
+    OP_ANNN,
+    OP_BNNN,
+    OP_CXNN,
+    OP_DXYN,
+    OP_EX9E,
+    OP_EXA1,
+    OP_F000,
+    OP_FN01,
+    OP_F002,
+    OP_FX07,
+    OP_FX0A,
+    OP_FX15,
+    OP_FX18,
+    OP_FX1E,
+    OP_FX29,
+    OP_FX30,
+    OP_FX33,
+    OP_FX3A,
+    OP_FX55,
+    OP_FX65,
+    OP_FX75,
+    OP_FX85,
+    OP_COUNT
+};
+
+//Superinstructions, instruction pairs executed as one
+enum {
+    FUSE_NONE,
+    FUSE_ANNN_DXYN,     //Point I at a sprite and draw it
+    FUSE_6XNN_FX15,     //Set the delay timer to a constant
+    FUSE_7XNN_3XNN,     //Loop counter increment and test
+    FUSE_FX1E_FX65,     //Index a table and load from it
+    FUSE_COUNT
+};
+
+//Reasons for run() to return
+enum StopReason {
+    STOP_BUDGET,        //Instruction budget exhausted
+    STOP_HALT,          //00FD stopped the interpreter
+    STOP_KEYWAIT,       //FX0A is waiting for a key
+    STOP_BREAKPOINT,    //Reached a breakpoint
+    STOP_UNKNOWN        //Executed an unknown opcode
+};
+
+//Predecoded instruction
+struct Instruction {
+    void (*handler)(Chip8&, const Instruction&);
+    uint16_t opcode;
+    uint16_t nnn;       //NNN, or NNNN for the double-length F000 instruction
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t nn;
+    uint8_t op;         //OP_ identifier
+
+    //Superinstruction formed with the next instruction, and its operands
+    uint8_t fuse;       //FUSE_ identifier
+    uint8_t x2;
+    uint8_t y2;
+    uint8_t n2;
+    uint8_t nn2;
+    uint16_t opcode2;
+
+    const void *thread; //Threaded core dispatch target, filled on first use
+};
+
 class Chip8 {
 
 public:
@@ -44,7 +168,7 @@ public:
     uint16_t opcode;
 
     //Memory
-    uint8_t memory[65535];
+    uint8_t memory[0x10000];
 
     //Registers
     uint8_t v[16];
@@ -52,8 +176,18 @@ public:
     uint16_t pc;
 
     //Graphics bitplanes
-    bool gfx[2][SCHIP_WH];
+    //One 128-pixel row per plane as two words, leftmost pixel in the top bit
+    //Lores screens are stored natively, one 64-pixel word per row in the
+    //first CHIP_H rows, unless a scroll by half a lores pixel expanded them.
+    alignas(32) uint64_t gfx[2][SCHIP_H][2];
     uint8_t bitPlane;
+    bool nativeLores;
+
+    //Screen rows changed since the last consumeDirty(), one bit per row
+    uint64_t dirtyRows = ~0ull;
+
+    //Horizontal scroll kernels, the fastest the host supports
+    const ScrollKernels *scrollKernels;
 
     //Color palette
     uint8_t palette[4][3];
@@ -62,8 +196,13 @@ public:
     uint8_t delayTimer;
     uint8_t soundTimer;
 
-    //XO-Chip audio buffer
+    //XO-Chip audio buffer, 128 1-bit samples played in a loop
+    //Until F002 fills it, the sound timer plays a plain buzzer
     uint8_t audioBuffer[16];
+    bool audioPattern;
+
+    //XO-Chip playback rate of the audio buffer, 4000*2^((pitch-64)/48) samples per second
+    uint8_t pitch;
 
     //Stack
     uint16_t stck[16];
@@ -74,6 +213,8 @@ public:
 
     //Keys
     bool keys[16];
+
+    //Blocked by FX0A, waiting for a key to store into waitRegister
     uint8_t waitRegister = 0;
     bool waiting = false;
 
@@ -85,6 +226,7 @@ public:
 
     //ROM loaded
     bool loaded;
+    uint32_t romSize = 0;
 
     //CHIP-8 font sprites
     uint8_t *fontSet;
@@ -98,12 +240,79 @@ public:
     //Game information
     uint32_t tickRate = 100;
 
+    //Predecoded instruction cache, one entry per memory address
+    //Entries with a null handler are decoded on the next fetch
+    Instruction cache[0x10000];
+
+    typedef void (*Handler)(Chip8&, const Instruction&);
+
+    //Handlers specialized for the current quirks, see selectQuirks()
+    const Handler *handlers;
+
+    template<uint8_t quirks>
+    static const Handler* handlerTable();
+
+    //Superinstruction handlers for the current quirks, indexed by FUSE_ identifier
+    const Handler *fusedHandlers;
+
+    template<uint8_t quirks>
+    static const Handler* fusedHandlerTable();
+
+    //Superinstructions executed, by FUSE_ identifier
+    uint64_t fuseHits[FUSE_COUNT] = {};
+
+    //Pixel of a bitplane, at hires screen coordinates
+    bool getPixel(uint8_t plane, uint8_t x, uint8_t y) const {
+        if(nativeLores)
+            return (gfx[plane][y >> 1][0] >> (63 - (x >> 1))) & 1;
+
+        return (gfx[plane][y][x >> 6] >> (63 - (x & 63))) & 1;
+    }
+
+    //Calls an instruction handler through a plain function pointer
+    template<void (Chip8::*handler)(const Instruction&)>
+    static void call(Chip8 &chip8, const Instruction &inst) {
+        (chip8.*handler)(inst);
+    }
+
+    //Selected interpreter core
+    uint8_t core = CORE_CACHED;
+
+    //Block recompiler, created when CORE_JIT is first used
+    Jit *jit = nullptr;
+
+    //Called on every memory write, for code translated outside the core
+    void (*writeHook)(void*, uint16_t, uint16_t) = nullptr;
+    void *writeHookData = nullptr;
+
+    //Part of the budget left unused by the last run()
+    uint32_t cyclesLeft = 0;
+
+    //Breakpoints, checked before each instruction while any is set
+    bool breakpoints[0x10000];
+    uint32_t breakpointCount = 0;
+    bool breakpointHit = false;
+
+    //Idle loop detection
+    //State seen at the last backward jump, compared on the next one
+    bool idleArmed = false;
+    uint16_t idleJump;
+    uint16_t idleI;
+    uint8_t idleV[16];
+
+    //Idle loops detected and instructions skipped
+    uint64_t idleLoops = 0;
+    uint64_t idleInstructions = 0;
+
     Chip8();
+    ~Chip8();
     void initialize();
     void unknownOpcode(uint16_t);
     uint8_t loadROM(std::string);
     uint8_t loadPalette(std::string);
     uint8_t checkKeys();
+    void pressKey(uint8_t);
+    void releaseKey(uint8_t);
     void updateTimers();
     uint8_t nextByte();
     uint16_t nextWord();
@@ -112,10 +321,85 @@ public:
     void scrollRight(uint8_t);
     void scrollUp(uint8_t);
     void scrollDown(uint8_t);
-    void pixel(uint8_t, uint8_t, uint8_t);
+    void clearPlanes(uint8_t);
+    void expandLores();
+    uint64_t consumeDirty();
+    uint64_t screenHash() const;
+    void setQuirks(uint8_t);
+    uint8_t getQuirks();
+    void selectQuirks();
+    void flushCache();
+    void invalidate(uint16_t, uint16_t);
+    void decode(uint16_t);
+    void setBreakpoint(uint16_t, bool);
     void emulateInstruction();
+    void emulateCycles(uint32_t);
+    StopReason run(uint32_t);
+    template<bool debug> StopReason runCached(uint32_t);
+    StopReason emulateThreaded(uint32_t);
+    uint32_t idleSkip(uint16_t, uint32_t);
     void printInstruction(uint16_t, uint16_t);
 
+    //Instruction handlers
+    void opUnknown(const Instruction&);
+    void opIgnore(const Instruction&);
+    void op00CN(const Instruction&);
+    void op00DN(const Instruction&);
+    void op00E0(const Instruction&);
+    void op00EE(const Instruction&);
+    void op00FB(const Instruction&);
+    void op00FC(const Instruction&);
+    void op00FD(const Instruction&);
+    void op00FE(const Instruction&);
+    void op00FF(const Instruction&);
+    void op1NNN(const Instruction&);
+    void op2NNN(const Instruction&);
+    void op3XNN(const Instruction&);
+    void op4XNN(const Instruction&);
+    void op5XY0(const Instruction&);
+    void op5XY2(const Instruction&);
+    void op5XY3(const Instruction&);
+    void op6XNN(const Instruction&);
+    void op7XNN(const Instruction&);
+    void op8XY0(const Instruction&);
+    void op8XY1(const Instruction&);
+    void op8XY2(const Instruction&);
+    void op8XY3(const Instruction&);
+    void op8XY4(const Instruction&);
+    void op8XY5(const Instruction&);
+    template<uint8_t quirks> void op8XY6(const Instruction&);
+    void op8XY7(const Instruction&);
+    template<uint8_t quirks> void op8XYE(const Instruction&);
+    void op9XY0(const Instruction&);
+    void opANNN(const Instruction&);
+    void opBNNN(const Instruction&);
+    void opCXNN(const Instruction&);
+    template<uint8_t quirks> void opDXYN(const Instruction&);
+    template<uint8_t quirks> void drawSprite(uint8_t, uint8_t, uint8_t);
+    void opEX9E(const Instruction&);
+    void opEXA1(const Instruction&);
+    void opF000(const Instruction&);
+    void opFN01(const Instruction&);
+    void opF002(const Instruction&);
+    void opFX07(const Instruction&);
+    void opFX0A(const Instruction&);
+    void opFX15(const Instruction&);
+    void opFX18(const Instruction&);
+    template<uint8_t quirks> void opFX1E(const Instruction&);
+    void opFX29(const Instruction&);
+    void opFX30(const Instruction&);
+    void opFX33(const Instruction&);
+    void opFX3A(const Instruction&);
+    template<uint8_t quirks> void opFX55(const Instruction&);
+    template<uint8_t quirks> void opFX65(const Instruction&);
+    void opFX75(const Instruction&);
+    void opFX85(const Instruction&);
+
+    //Superinstruction handlers
+    template<uint8_t quirks> void fuseANNN_DXYN(const Instruction&);
+    void fuse6XNN_FX15(const Instruction&);
+    void fuse7XNN_3XNN(const Instruction&);
+    template<uint8_t quirks> void fuseFX1E_FX65(const Instruction&);
 
 };
 
@@ -0,0 +1,150 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "compose.hpp"
+
+#ifdef COMPOSE_X64
+#include <immintrin.h>
+#endif
+
+//Output rows are SCHIP_W pixels, leftmost pixel first.
+//Rows hold the leftmost pixel in the top bit of their first word.
+
+static void scalarCompose(const uint64_t (*gfx)[SCHIP_H][2], const uint32_t *colors, uint64_t rows, uint32_t words, uint32_t *out) {
+
+    for(uint32_t y = 0 ; y < SCHIP_H ; y++) {
+        if(((rows >> y) & 1) == 0)
+            continue;
+
+        uint32_t *pixels = out + y * SCHIP_W;
+
+        for(uint32_t w = 0 ; w < words ; w++) {
+            uint64_t p0 = gfx[0][y][w];
+            uint64_t p1 = gfx[1][y][w];
+
+            for(int32_t bit = 63 ; bit >= 0 ; bit--)
+                *pixels++ = colors[(((p1 >> bit) & 1) << 1) | ((p0 >> bit) & 1)];
+        }
+    }
+}
+
+const ComposeKernel composeScalar = {"scalar", &scalarCompose};
+
+#ifdef COMPOSE_X64
+
+//The 4-entry table fits in one register, and PSHUFB looks up the bytes of
+//several pixels at once. Each pixel's bits are tested against a mask moving
+//down the 32-bit half of a row word, and the results select the table entry :
+//the shuffle control of a pixel is (index * 4) + {0, 1, 2, 3}.
+
+//SSSE3, four pixels per register
+__attribute__((target("ssse3")))
+static void ssse3Compose(const uint64_t (*gfx)[SCHIP_H][2], const uint32_t *colors, uint64_t rows, uint32_t words, uint32_t *out) {
+
+    const __m128i table = _mm_loadu_si128((const __m128i*)colors);
+    const __m128i first = _mm_set_epi32(1 << 28, 1 << 29, 1 << 30, (int)(1u << 31));
+    const __m128i bytes = _mm_set1_epi32(0x03020100);
+    const __m128i select0 = _mm_set1_epi32(0x04040404);
+    const __m128i select1 = _mm_set1_epi32(0x08080808);
+
+    for(uint32_t y = 0 ; y < SCHIP_H ; y++) {
+        if(((rows >> y) & 1) == 0)
+            continue;
+
+        __m128i *pixels = (__m128i*)(out + y * SCHIP_W);
+
+        //32-pixel halves of the row words
+        for(uint32_t h = 0 ; h < 2 * words ; h++) {
+            uint32_t shift = (h & 1) ? 0 : 32;
+            __m128i p0 = _mm_set1_epi32((int)(uint32_t)(gfx[0][y][h >> 1] >> shift));
+            __m128i p1 = _mm_set1_epi32((int)(uint32_t)(gfx[1][y][h >> 1] >> shift));
+            __m128i mask = first;
+
+            for(uint32_t i = 0 ; i < 8 ; i++) {
+                __m128i m0 = _mm_cmpeq_epi32(_mm_and_si128(p0, mask), mask);
+                __m128i m1 = _mm_cmpeq_epi32(_mm_and_si128(p1, mask), mask);
+                __m128i control = _mm_or_si128(bytes, _mm_or_si128(_mm_and_si128(m0, select0), _mm_and_si128(m1, select1)));
+
+                _mm_storeu_si128(pixels++, _mm_shuffle_epi8(table, control));
+                mask = _mm_srli_epi32(mask, 4);
+            }
+        }
+    }
+}
+
+const ComposeKernel composeSsse3 = {"ssse3", &ssse3Compose};
+
+//AVX2, eight pixels per register
+//The table is copied to both 128-bit lanes, since VPSHUFB looks up within each lane
+__attribute__((target("avx2")))
+static void avx2Compose(const uint64_t (*gfx)[SCHIP_H][2], const uint32_t *colors, uint64_t rows, uint32_t words, uint32_t *out) {
+
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)colors));
+    const __m256i first = _mm256_set_epi32(1 << 24, 1 << 25, 1 << 26, 1 << 27, 1 << 28, 1 << 29, 1 << 30, (int)(1u << 31));
+    const __m256i bytes = _mm256_set1_epi32(0x03020100);
+    const __m256i select0 = _mm256_set1_epi32(0x04040404);
+    const __m256i select1 = _mm256_set1_epi32(0x08080808);
+
+    for(uint32_t y = 0 ; y < SCHIP_H ; y++) {
+        if(((rows >> y) & 1) == 0)
+            continue;
+
+        __m256i *pixels = (__m256i*)(out + y * SCHIP_W);
+
+        for(uint32_t h = 0 ; h < 2 * words ; h++) {
+            uint32_t shift = (h & 1) ? 0 : 32;
+            __m256i p0 = _mm256_set1_epi32((int)(uint32_t)(gfx[0][y][h >> 1] >> shift));
+            __m256i p1 = _mm256_set1_epi32((int)(uint32_t)(gfx[1][y][h >> 1] >> shift));
+            __m256i mask = first;
+
+            for(uint32_t i = 0 ; i < 4 ; i++) {
+                __m256i m0 = _mm256_cmpeq_epi32(_mm256_and_si256(p0, mask), mask);
+                __m256i m1 = _mm256_cmpeq_epi32(_mm256_and_si256(p1, mask), mask);
+                __m256i control = _mm256_or_si256(bytes, _mm256_or_si256(_mm256_and_si256(m0, select0), _mm256_and_si256(m1, select1)));
+
+                _mm256_storeu_si256(pixels++, _mm256_shuffle_epi8(table, control));
+                mask = _mm256_srli_epi32(mask, 8);
+            }
+        }
+    }
+}
+
+const ComposeKernel composeAvx2 = {"avx2", &avx2Compose};
+
+#endif
+
+const ComposeKernel* selectComposeKernel() {
+#ifdef COMPOSE_X64
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx2"))
+        return &composeAvx2;
+
+    if(__builtin_cpu_supports("ssse3"))
+        return &composeSsse3;
+#endif
+
+    return &composeScalar;
+}
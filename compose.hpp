@@ -0,0 +1,60 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef COMPOSE_HPP_INCLUDED
+#define COMPOSE_HPP_INCLUDED
+
+#include <cstdint>
+
+#include "chip8.hpp"
+
+//Vector kernels are built for x86-64 and picked at run time
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define COMPOSE_X64
+#endif
+
+//Palette composition
+//Converts the given rows (one bit per row) of both bitplanes to 32-bit
+//colors, looking each pixel up in a 4-entry table indexed by plane 1 << 1 | plane 0.
+//Two-color machines use a table with the same color in entries 1 to 3.
+//Rows are 1 (native lores) or 2 words wide, output rows are SCHIP_W pixels apart.
+typedef void (*ComposeFunc)(const uint64_t (*)[SCHIP_H][2], const uint32_t*, uint64_t, uint32_t, uint32_t*);
+
+struct ComposeKernel {
+    const char *name;
+    ComposeFunc compose;
+};
+
+extern const ComposeKernel composeScalar;
+
+#ifdef COMPOSE_X64
+extern const ComposeKernel composeSsse3;
+extern const ComposeKernel composeAvx2;
+#endif
+
+//Fastest kernel supported by the host
+const ComposeKernel* selectComposeKernel();
+
+#endif // COMPOSE_HPP_INCLUDED
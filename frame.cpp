@@ -0,0 +1,67 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "frame.hpp"
+
+#include <cstring>
+
+//Copy the screen and palette, consume the dirty rows and hash the planes
+void Frame::capture(Chip8 *chip8) {
+    memcpy(gfx, chip8->gfx, sizeof(gfx));
+    nativeLores = chip8->nativeLores;
+    memcpy(palette, chip8->palette, sizeof(palette));
+
+    dirtyRows = chip8->consumeDirty();
+    hash = chip8->screenHash();
+    tickRate = chip8->tickRate;
+}
+
+Frame* TripleBuffer::back() {
+    return &frames[backIndex];
+}
+
+Frame* TripleBuffer::publish() {
+
+    frames[backIndex].sequence = ++published;
+
+    uint8_t old = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel);
+    backIndex = old & ~FRESH;
+
+    if(old & FRESH)
+        dropped++;
+
+    return &frames[backIndex];
+}
+
+Frame* TripleBuffer::acquire() {
+
+    if((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+        return nullptr;
+
+    uint8_t old = middle.exchange(frontIndex, std::memory_order_acq_rel);
+    frontIndex = old & ~FRESH;
+
+    return &frames[frontIndex];
+}
@@ -0,0 +1,92 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef FRAME_HPP_INCLUDED
+#define FRAME_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+
+#include "chip8.hpp"
+
+//Completed frame, copied out of the core at the end of each emulated frame
+struct Frame {
+    alignas(32) uint64_t gfx[2][SCHIP_H][2];
+    bool nativeLores;
+    uint8_t palette[4][3];
+
+    //Rows changed since the previous frame
+    uint64_t dirtyRows;
+
+    //Chip8::screenHash() of the planes
+    uint64_t hash;
+
+    //Frame number, set when published
+    uint64_t sequence;
+
+    uint32_t tickRate;
+
+    //Emulation speed relative to 60 frames per second while fast-forwarding, 0 otherwise
+    float speed;
+
+    void capture(Chip8*);
+};
+
+//Lock-free triple buffer
+//The emulation thread fills the back frame and publishes it, the display
+//takes the latest published one. Neither side waits for the other, frames
+//the display doesn't take in time are replaced by newer ones.
+class TripleBuffer {
+
+public:
+
+    //Frame the emulation thread writes to
+    Frame* back();
+
+    //Publish the back frame, and return a new one to write to
+    Frame* publish();
+
+    //Take the latest published frame, or return nullptr when there is none
+    Frame* acquire();
+
+    //Frames replaced before the display took them
+    uint64_t dropped = 0;
+
+private:
+
+    static const uint8_t FRESH = 4;
+
+    Frame frames[3] = {};
+
+    //Published frame index, FRESH until the display takes it
+    std::atomic<uint8_t> middle{1};
+
+    uint8_t backIndex = 0;  //Owned by the emulation thread
+    uint8_t frontIndex = 2; //Owned by the display thread
+
+    uint64_t published = 0;
+};
+
+#endif // FRAME_HPP_INCLUDED
@@ -0,0 +1,812 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "jit.hpp"
+#include "chip8.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <climits>
+
+#ifdef JIT_X64
+#include <sys/mman.h>
+#endif
+
+//Host registers
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RBP 5
+#define RSI 6
+#define RDI 7
+
+//Condition codes
+#define CC_C 0x2
+#define CC_NC 0x3
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_A 0x7
+#define CC_L 0xC
+
+//ALU opcodes (op r/m8, r8) and their immediate form extensions (0x80 /ext)
+#define ALU_ADD 0x00
+#define ALU_OR 0x08
+#define ALU_AND 0x20
+#define ALU_SUB 0x28
+#define ALU_XOR 0x30
+#define ALU_CMP 0x38
+#define ALU_MOV 0x88
+#define EXT_ADD 0
+#define EXT_CMP 7
+
+//Chip8 state offsets, the state pointer lives in RBX
+#define OFF_V(x) ((uint32_t)(offsetof(Chip8, v) + (x)))
+#define OFF_I ((uint32_t)offsetof(Chip8, I))
+#define OFF_PC ((uint32_t)offsetof(Chip8, pc))
+#define OFF_SP ((uint32_t)offsetof(Chip8, sp))
+#define OFF_STACK ((uint32_t)offsetof(Chip8, stck))
+#define OFF_KEYS ((uint32_t)offsetof(Chip8, keys))
+#define OFF_DELAY ((uint32_t)offsetof(Chip8, delayTimer))
+#define OFF_SOUND ((uint32_t)offsetof(Chip8, soundTimer))
+
+//Host registers holding V registers inside a block
+//R15 holds the remaining cycle budget, RAX and RCX are scratch registers
+static const uint8_t registerPool[] = {RBP, 12, 13, 14, RSI, RDI, 8, 9, 10, 11, RDX};
+#define POOL_SIZE 11
+
+Jit::Jit(Chip8 *chip8) {
+    this->chip8 = chip8;
+
+#ifdef JIT_X64
+    //Never writable and executable at once : blocks are emitted and patched
+    //while it's writable, and it's made executable before running them
+    void *mem = mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(mem != MAP_FAILED)
+        buffer = (uint8_t*)mem;
+#endif
+
+    memset(blocks, 0, sizeof(blocks));
+    reset();
+}
+
+Jit::~Jit() {
+    for(JitBlock *block : allBlocks)
+        delete block;
+
+#ifdef JIT_X64
+    if(buffer != nullptr)
+        munmap(buffer, JIT_CODE_SIZE);
+#endif
+}
+
+//Native code can be generated on this host
+bool Jit::available() {
+    return buffer != nullptr;
+}
+
+//Switch the code buffer between writable and executable, only when needed
+//When the system refuses, native code is never run again
+bool Jit::protect(bool write) {
+    if(disabled)
+        return false;
+
+#ifdef JIT_X64
+    if(writable != write) {
+        if(mprotect(buffer, JIT_CODE_SIZE, write ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0) {
+            disabled = true;
+            return false;
+        }
+
+        writable = write;
+    }
+#endif
+
+    return true;
+}
+
+//Drop every translated block
+void Jit::flush() {
+    reset();
+}
+
+//Clear all blocks and start a new code buffer
+void Jit::reset() {
+    for(JitBlock *block : allBlocks)
+        delete block;
+
+    allBlocks.clear();
+    pendingLinks.clear();
+
+    for(uint16_t page = 0 ; page < 256 ; page ++)
+        pages[page].clear();
+
+    memset(entries, 0, sizeof(entries));
+    memset(blocks, 0, sizeof(blocks));
+    memset(interpretOnly, false, sizeof(interpretOnly));
+
+    emitPtr = buffer;
+
+    if(buffer != nullptr && protect(true))
+        emitTrampoline();
+}
+
+//Emulate a number of instructions, running translated blocks when possible
+StopReason Jit::run(uint32_t cycles) {
+
+    while(cycles > 0) {
+
+        uint16_t pc = chip8->pc;
+        const uint8_t *code = entries[pc];
+
+        if(code == nullptr && buffer != nullptr && !interpretOnly[pc]) {
+            JitBlock *block = compile(pc);
+
+            if(block != nullptr)
+                code = block->code;
+            else
+                interpretOnly[pc] = true;
+        }
+
+        if(code != nullptr && protect(false)) {
+            int32_t budget = (cycles > INT32_MAX) ? INT32_MAX : cycles;
+            int32_t left = enter(chip8, code, budget);
+
+            //Blocks refuse to run when the budget is too small for them
+            if(left != budget) {
+                nativeInstructions += budget - left;
+                cycles -= budget - left;
+                continue;
+            }
+        }
+
+        //Blocks never contain the instructions that stop run()
+        chip8->emulateInstruction();
+        interpretedInstructions ++;
+        cycles --;
+
+        uint8_t op = chip8->cache[pc].op;
+
+        if(op == OP_UNKNOWN || op == OP_00FD || op == OP_FX0A) {
+            chip8->cyclesLeft = cycles;
+
+            if(op == OP_UNKNOWN)
+                return STOP_UNKNOWN;
+
+            return (op == OP_00FD) ? STOP_HALT : STOP_KEYWAIT;
+        }
+    }
+
+    chip8->cyclesLeft = 0;
+    return STOP_BUDGET;
+}
+
+//Invalidate blocks that read memory in [addr, addr + len)
+void Jit::invalidate(uint16_t addr, uint16_t len) {
+
+    uint32_t low = addr;
+    uint32_t high = (uint32_t)addr + len;
+
+    for(uint32_t page = low >> 8 ; page <= ((high - 1) >> 8) && page < 256 ; page ++) {
+
+        //kill() removes blocks from the page list
+        std::vector<JitBlock*> list = pages[page];
+
+        for(JitBlock *block : list)
+            if(block->alive && block->start < high && block->end > low)
+                kill(block);
+    }
+
+    //Instructions that couldn't be translated may have changed
+    for(uint32_t i = 0 ; i < len + 3u ; i ++)
+        interpretOnly[(uint16_t)(addr - 3 + i)] = false;
+}
+
+//Remove a block and unlink every jump into it
+void Jit::kill(JitBlock *block) {
+    block->alive = false;
+
+    //Nothing runs from the buffer anymore if it can't be written to
+    bool patchable = protect(true);
+
+    entries[block->start] = nullptr;
+    blocks[block->start] = nullptr;
+
+    for(uint8_t *site : block->incoming) {
+        if(patchable)
+            patch(site, epilogue);
+
+        pendingLinks[block->start].push_back(site);
+    }
+
+    block->incoming.clear();
+
+    for(uint32_t page = block->start >> 8 ; page <= ((block->end - 1) >> 8) && page < 256 ; page ++) {
+        std::vector<JitBlock*> &list = pages[page];
+
+        for(size_t i = 0 ; i < list.size() ; i ++) {
+            if(list[i] == block) {
+                list.erase(list.begin() + i);
+                break;
+            }
+        }
+    }
+}
+
+//Point a block exit at its target block, or remember it until the target is compiled
+void Jit::link(uint8_t *site, uint16_t target) {
+    JitBlock *block = blocks[target];
+
+    if(block != nullptr) {
+        patch(site, block->code);
+        block->incoming.push_back(site);
+    }
+    else
+        pendingLinks[target].push_back(site);
+}
+
+//Rewrite the rel32 operand at site
+void Jit::patch(uint8_t *site, const uint8_t *target) {
+    int32_t rel = (int32_t)(target - (site + 4));
+    memcpy(site, &rel, 4);
+}
+
+//V registers accessed by an instruction, or -1 if the recompiler can't translate it
+static int32_t registersUsed(const Instruction &inst, bool shiftQuirk) {
+
+    uint16_t x = 1 << inst.x;
+    uint16_t y = 1 << inst.y;
+
+    switch(inst.op) {
+        case OP_00EE:
+        case OP_1NNN:
+        case OP_2NNN:
+        case OP_ANNN:
+        case OP_F000:
+            return 0;
+
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_6XNN:
+        case OP_7XNN:
+        case OP_EX9E:
+        case OP_EXA1:
+        case OP_FX07:
+        case OP_FX15:
+        case OP_FX18:
+        case OP_FX29:
+        case OP_FX30:
+            return x;
+
+        case OP_5XY0:
+        case OP_9XY0:
+        case OP_8XY0:
+        case OP_8XY1:
+        case OP_8XY2:
+        case OP_8XY3:
+            return x | y;
+
+        case OP_8XY4:
+        case OP_8XY5:
+        case OP_8XY7:
+            return x | y | 0x8000;
+
+        case OP_8XY6:
+        case OP_8XYE:
+            return x | (shiftQuirk ? 0 : y) | 0x8000;
+
+        case OP_FX1E:
+            return x | (shiftQuirk ? 0x8000 : 0);
+
+        case OP_BNNN:
+            return 1;
+
+        default:
+            return -1;
+    }
+}
+
+//Instruction ends a block
+static bool endsBlock(uint8_t op) {
+    switch(op) {
+        case OP_00EE:
+        case OP_1NNN:
+        case OP_2NNN:
+        case OP_BNNN:
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_9XY0:
+        case OP_EX9E:
+        case OP_EXA1:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+//Translate the basic block starting at start
+JitBlock* Jit::compile(uint16_t start) {
+
+    //Largest possible block, with room to spare
+    if(emitPtr + 64 * JIT_MAX_BLOCK + 1024 > buffer + JIT_CODE_SIZE)
+        reset();
+
+    if(!protect(true))
+        return nullptr;
+
+    //First pass : find the end of the block and the V registers it uses
+    uint32_t addr = start;
+    uint32_t count = 0;
+    uint16_t used = 0;
+    bool terminated = false;
+
+    while(count < JIT_MAX_BLOCK && addr + 4 <= 0xFFFF) {
+
+        Instruction &inst = chip8->cache[addr];
+
+        if(inst.handler == nullptr)
+            chip8->decode(addr);
+
+        int32_t regs = registersUsed(inst, chip8->shiftQuirk);
+
+        if(regs < 0 || __builtin_popcount(used | regs) > POOL_SIZE)
+            break;
+
+        used |= regs;
+        count ++;
+        addr += (inst.op == OP_F000) ? 4 : 2;
+
+        if(endsBlock(inst.op)) {
+            terminated = true;
+            break;
+        }
+    }
+
+    if(count == 0)
+        return nullptr;
+
+    JitBlock *block = new JitBlock();
+    block->start = start;
+    block->count = count;
+    block->code = emitPtr;
+    block->alive = true;
+    block->end = addr;
+
+    allBlocks.push_back(block);
+
+    //Block entry : exit if the budget is too small, pc is already set
+    emit8(0x41); emit8(0x81); emit8(0xFF); emit32(count);   //cmp r15d, count
+    emitJcc(CC_L, epilogue);
+    emit8(0x41); emit8(0x81); emit8(0xEF); emit32(count);   //sub r15d, count
+
+    //Pin used V registers to host registers
+    uint8_t reg[16];
+    uint8_t next = 0;
+
+    for(uint8_t i = 0 ; i < 16 ; i ++) {
+        if((used & (1 << i)) != 0) {
+            reg[i] = registerPool[next ++];
+            emitLoadByte(reg[i], OFF_V(i));
+        }
+    }
+
+    uint16_t written = 0;
+
+    //Store modified V registers, set pc and leave for target
+    auto exitTo = [&](uint16_t target) {
+        for(uint8_t i = 0 ; i < 16 ; i ++)
+            if((written & (1 << i)) != 0)
+                emitStoreByte(OFF_V(i), reg[i]);
+
+        emitStoreWordImm(OFF_PC, target);
+        link(emitJmp(epilogue), target);
+    };
+
+    //Store modified V registers, pc is in AX
+    auto exitIndirect = [&]() {
+        for(uint8_t i = 0 ; i < 16 ; i ++)
+            if((written & (1 << i)) != 0)
+                emitStoreByte(OFF_V(i), reg[i]);
+
+        emitStoreAx(OFF_PC);
+        emitIndirectJump();
+    };
+
+    //Skip next instruction when the condition code skipIf is met
+    auto skip = [&](uint8_t skipIf, uint16_t nextPc) {
+        uint16_t word = (chip8->memory[nextPc] << 8) | chip8->memory[nextPc + 1];
+        uint16_t skipPc = nextPc + ((word == 0xF000) ? 4 : 2);
+
+        if(nextPc + 2u > block->end)
+            block->end = nextPc + 2;
+
+        //Inverted condition jumps over the skipping exit
+        emit8(0x0F); emit8(0x80 | (skipIf ^ 1));
+        uint8_t *site = emitPtr;
+        emit32(0);
+
+        exitTo(skipPc);
+        patch(site, emitPtr);
+        exitTo(nextPc);
+    };
+
+    addr = start;
+
+    for(uint32_t k = 0 ; k < count ; k ++) {
+
+        Instruction &inst = chip8->cache[addr];
+        uint8_t x = reg[inst.x];
+        uint8_t y = reg[inst.y];
+        uint8_t f = reg[0xF];
+        uint16_t nextPc = addr + ((inst.op == OP_F000) ? 4 : 2);
+
+        switch(inst.op) {
+
+            case OP_00EE: {
+                emit8(0xFE); emit8(0x8B); emit32(OFF_SP);               //dec byte [sp]
+                emit8(0x0F); emit8(0xB6); emit8(0x83); emit32(OFF_SP);  //movzx eax, byte [sp]
+                emit8(0x0F); emit8(0xB7); emit8(0x84); emit8(0x43);     //movzx eax, word [stck + rax*2]
+                emit32(OFF_STACK);
+                exitIndirect();
+                break;
+            }
+
+            case OP_1NNN: {
+                exitTo(inst.nnn);
+                break;
+            }
+
+            case OP_2NNN: {
+                emit8(0x0F); emit8(0xB6); emit8(0x83); emit32(OFF_SP);  //movzx eax, byte [sp]
+                emit8(0x66); emit8(0xC7); emit8(0x84); emit8(0x43);     //mov word [stck + rax*2], nextPc
+                emit32(OFF_STACK); emit16(nextPc);
+                emit8(0xFE); emit8(0x83); emit32(OFF_SP);               //inc byte [sp]
+                exitTo(inst.nnn);
+                break;
+            }
+
+            case OP_3XNN: {
+                emitAluImm(EXT_CMP, x, inst.nn);
+                skip(CC_E, nextPc);
+                break;
+            }
+
+            case OP_4XNN: {
+                emitAluImm(EXT_CMP, x, inst.nn);
+                skip(CC_NE, nextPc);
+                break;
+            }
+
+            case OP_5XY0: {
+                emitAlu(ALU_CMP, x, y);
+                skip(CC_E, nextPc);
+                break;
+            }
+
+            case OP_9XY0: {
+                emitAlu(ALU_CMP, x, y);
+                skip(CC_NE, nextPc);
+                break;
+            }
+
+            case OP_6XNN: {
+                emitMovImm(x, inst.nn);
+                written |= 1 << inst.x;
+                break;
+            }
+
+            case OP_7XNN: {
+                emitAluImm(EXT_ADD, x, inst.nn);
+                written |= 1 << inst.x;
+                break;
+            }
+
+            case OP_8XY0: emitAlu(ALU_MOV, x, y); written |= 1 << inst.x; break;
+            case OP_8XY1: emitAlu(ALU_OR, x, y); written |= 1 << inst.x; break;
+            case OP_8XY2: emitAlu(ALU_AND, x, y); written |= 1 << inst.x; break;
+            case OP_8XY3: emitAlu(ALU_XOR, x, y); written |= 1 << inst.x; break;
+
+            case OP_8XY4: {
+                //Carry flag is the CHIP-8 carry
+                emitAlu(ALU_ADD, x, y);
+                emitSet(CC_C, f);
+                written |= (1 << inst.x) | 0x8000;
+                break;
+            }
+
+            case OP_8XY5: {
+                //VF = not borrow
+                emitAlu(ALU_SUB, x, y);
+                emitSet(CC_NC, f);
+                written |= (1 << inst.x) | 0x8000;
+                break;
+            }
+
+            case OP_8XY7: {
+                emitAlu(ALU_MOV, RAX, y);
+                emitAlu(ALU_SUB, RAX, x);
+                emitSet(CC_NC, RCX);
+                emitAlu(ALU_MOV, x, RAX);
+                emitAlu(ALU_MOV, f, RCX);
+                written |= (1 << inst.x) | 0x8000;
+                break;
+            }
+
+            case OP_8XY6:
+            case OP_8XYE: {
+                uint8_t source = chip8->shiftQuirk ? x : y;
+
+                //Shifted out bit goes to the carry flag
+                emitAlu(ALU_MOV, RAX, source);
+                emit8(0x40); emit8(0xD0); emit8((inst.op == OP_8XY6) ? 0xE8 : 0xE0); //shr/shl al, 1
+                emitSet(CC_C, RCX);
+                emitAlu(ALU_MOV, x, RAX);
+                emitAlu(ALU_MOV, f, RCX);
+                written |= (1 << inst.x) | 0x8000;
+                break;
+            }
+
+            case OP_ANNN: {
+                emitStoreWordImm(OFF_I, inst.nnn);
+                break;
+            }
+
+            case OP_F000: {
+                emitStoreWordImm(OFF_I, inst.nnn);
+                break;
+            }
+
+            case OP_BNNN: {
+                emitZeroExtend(RAX, reg[0]);
+                emit8(0x05); emit32(inst.nnn);                          //add eax, nnn
+                exitIndirect();
+                break;
+            }
+
+            case OP_EX9E:
+            case OP_EXA1: {
+                emitZeroExtend(RAX, x);
+                emit8(0x83); emit8(0xE0); emit8(0x0F);                  //and eax, 0xF
+                emit8(0x80); emit8(0xBC); emit8(0x03); emit32(OFF_KEYS);//cmp byte [keys + rax], 0
+                emit8(0x00);
+                skip((inst.op == OP_EX9E) ? CC_NE : CC_E, nextPc);
+                break;
+            }
+
+            case OP_FX07: {
+                emitLoadByte(x, OFF_DELAY);
+                written |= 1 << inst.x;
+                break;
+            }
+
+            case OP_FX15: emitStoreByte(OFF_DELAY, x); break;
+            case OP_FX18: emitStoreByte(OFF_SOUND, x); break;
+
+            case OP_FX1E: {
+                emitZeroExtend(RAX, x);
+                emit8(0x0F); emit8(0xB7); emit8(0x8B); emit32(OFF_I);   //movzx ecx, word [I]
+                emit8(0x01); emit8(0xC1);                               //add ecx, eax
+                emit8(0x66); emit8(0x89); emit8(0x8B); emit32(OFF_I);   //mov word [I], cx
+
+                //SUPERCHIP overflow flag
+                if(chip8->shiftQuirk) {
+                    emit8(0x81); emit8(0xF9); emit32(0xFFF);            //cmp ecx, 0xFFF
+                    emitSet(CC_A, f);
+                    written |= 0x8000;
+                }
+                break;
+            }
+
+            case OP_FX29:
+            case OP_FX30: {
+                emitZeroExtend(RAX, x);
+                emit8(0x8D); emit8(0x04); emit8(0x80);                  //lea eax, [rax + rax*4]
+
+                if(inst.op == OP_FX30) {
+                    emit8(0x8D); emit8(0x44); emit8(0x00); emit8(80);   //lea eax, [rax + rax + 80]
+                }
+
+                emitStoreAx(OFF_I);
+                break;
+            }
+
+            default: break;
+        }
+
+        addr = nextPc;
+    }
+
+    //Continue with the next block or the interpreter
+    if(!terminated)
+        exitTo(addr);
+
+    //Register the block, then link jumps that were waiting for it
+    entries[start] = block->code;
+    blocks[start] = block;
+
+    for(uint32_t page = start >> 8 ; page <= ((block->end - 1) >> 8) && page < 256 ; page ++)
+        pages[page].push_back(block);
+
+    auto pending = pendingLinks.find(start);
+
+    if(pending != pendingLinks.end()) {
+        for(uint8_t *site : pending->second) {
+            patch(site, block->code);
+            block->incoming.push_back(site);
+        }
+
+        pendingLinks.erase(pending);
+    }
+
+    blocksCompiled ++;
+
+    return block;
+}
+
+void Jit::emit8(uint8_t value) {
+    *emitPtr++ = value;
+}
+
+void Jit::emit16(uint16_t value) {
+    memcpy(emitPtr, &value, 2);
+    emitPtr += 2;
+}
+
+void Jit::emit32(uint32_t value) {
+    memcpy(emitPtr, &value, 4);
+    emitPtr += 4;
+}
+
+void Jit::emit64(uint64_t value) {
+    memcpy(emitPtr, &value, 8);
+    emitPtr += 8;
+}
+
+void Jit::emitRel32(const uint8_t *target) {
+    patch(emitPtr, target);
+    emitPtr += 4;
+}
+
+//Entry and exit code shared by all blocks
+//int32_t enter(Chip8 *state, const uint8_t *code, int32_t budget) returns the remaining budget
+void Jit::emitTrampoline() {
+    enter = (Entry)emitPtr;
+
+    emit8(0x53);                                //push rbx
+    emit8(0x55);                                //push rbp
+    emit8(0x41); emit8(0x54);                   //push r12
+    emit8(0x41); emit8(0x55);                   //push r13
+    emit8(0x41); emit8(0x56);                   //push r14
+    emit8(0x41); emit8(0x57);                   //push r15
+    emit8(0x48); emit8(0x83); emit8(0xEC); emit8(0x08); //sub rsp, 8
+    emit8(0x48); emit8(0x89); emit8(0xFB);      //mov rbx, rdi
+    emit8(0x41); emit8(0x89); emit8(0xD7);      //mov r15d, edx
+    emit8(0xFF); emit8(0xE6);                   //jmp rsi
+
+    epilogue = emitPtr;
+
+    emit8(0x44); emit8(0x89); emit8(0xF8);      //mov eax, r15d
+    emit8(0x48); emit8(0x83); emit8(0xC4); emit8(0x08); //add rsp, 8
+    emit8(0x41); emit8(0x5F);                   //pop r15
+    emit8(0x41); emit8(0x5E);                   //pop r14
+    emit8(0x41); emit8(0x5D);                   //pop r13
+    emit8(0x41); emit8(0x5C);                   //pop r12
+    emit8(0x5D);                                //pop rbp
+    emit8(0x5B);                                //pop rbx
+    emit8(0xC3);                                //ret
+}
+
+//op r/m8, r8
+void Jit::emitAlu(uint8_t opcode, uint8_t dst, uint8_t src) {
+    emit8(0x40 | ((src >> 3) << 2) | (dst >> 3));
+    emit8(opcode);
+    emit8(0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+//op r/m8, imm8
+void Jit::emitAluImm(uint8_t ext, uint8_t dst, uint8_t imm) {
+    emit8(0x40 | (dst >> 3));
+    emit8(0x80);
+    emit8(0xC0 | (ext << 3) | (dst & 7));
+    emit8(imm);
+}
+
+//mov r8, imm8
+void Jit::emitMovImm(uint8_t dst, uint8_t imm) {
+    emit8(0x40 | (dst >> 3));
+    emit8(0xB0 | (dst & 7));
+    emit8(imm);
+}
+
+//movzx r32, byte [rbx + offset]
+void Jit::emitLoadByte(uint8_t dst, uint32_t offset) {
+    if(dst >= 8)
+        emit8(0x44);
+
+    emit8(0x0F); emit8(0xB6);
+    emit8(0x80 | ((dst & 7) << 3) | RBX);
+    emit32(offset);
+}
+
+//mov byte [rbx + offset], r8
+void Jit::emitStoreByte(uint32_t offset, uint8_t src) {
+    emit8(0x40 | ((src >> 3) << 2));
+    emit8(0x88);
+    emit8(0x80 | ((src & 7) << 3) | RBX);
+    emit32(offset);
+}
+
+//movzx r32, r8
+void Jit::emitZeroExtend(uint8_t dst, uint8_t src) {
+    emit8(0x40 | ((dst >> 3) << 2) | (src >> 3));
+    emit8(0x0F); emit8(0xB6);
+    emit8(0xC0 | ((dst & 7) << 3) | (src & 7));
+}
+
+//setcc r8
+void Jit::emitSet(uint8_t cc, uint8_t dst) {
+    emit8(0x40 | (dst >> 3));
+    emit8(0x0F); emit8(0x90 | cc);
+    emit8(0xC0 | (dst & 7));
+}
+
+//mov word [rbx + offset], imm16
+void Jit::emitStoreWordImm(uint32_t offset, uint16_t imm) {
+    emit8(0x66); emit8(0xC7); emit8(0x83);
+    emit32(offset);
+    emit16(imm);
+}
+
+//mov word [rbx + offset], ax
+void Jit::emitStoreAx(uint32_t offset) {
+    emit8(0x66); emit8(0x89); emit8(0x83);
+    emit32(offset);
+}
+
+//jcc rel32
+void Jit::emitJcc(uint8_t cc, const uint8_t *target) {
+    emit8(0x0F); emit8(0x80 | cc);
+    emitRel32(target);
+}
+
+//jmp rel32, returns the address of the operand for patching
+uint8_t* Jit::emitJmp(const uint8_t *target) {
+    emit8(0xE9);
+    uint8_t *site = emitPtr;
+    emitRel32(target);
+
+    return site;
+}
+
+//Jump to the block at pc (in EAX), or leave if it isn't compiled
+void Jit::emitIndirectJump() {
+    emit8(0x48); emit8(0xB9); emit64((uint64_t)entries);   //mov rcx, entries
+    emit8(0x48); emit8(0x8B); emit8(0x04); emit8(0xC1);    //mov rax, [rcx + rax*8]
+    emit8(0x48); emit8(0x85); emit8(0xC0);                 //test rax, rax
+    emitJcc(CC_E, epilogue);
+    emit8(0xFF); emit8(0xE0);                              //jmp rax
+}
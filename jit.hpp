@@ -0,0 +1,126 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef JIT_HPP_INCLUDED
+#define JIT_HPP_INCLUDED
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include "chip8.hpp"
+
+//The recompiler emits x86-64 System V code
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_X64
+#endif
+
+#define JIT_CODE_SIZE 0x400000  //Code buffer size
+#define JIT_MAX_BLOCK 64        //Maximum instructions per block
+
+//Translated basic block
+struct JitBlock {
+    uint16_t start;                 //Address of the first instruction
+    uint32_t end;                   //End of the memory range read by the block
+    uint32_t count;                 //Instructions executed by the block
+    uint8_t *code;                  //Native entry point
+    bool alive;
+    std::vector<uint8_t*> incoming; //Jumps from other blocks into this one
+};
+
+//Basic block recompiler
+//Translates straight-line CHIP-8 code into x86-64 and chains blocks together.
+//Instructions it can't translate are run by the interpreter.
+class Jit {
+
+public:
+
+    Chip8 *chip8;
+
+    //Statistics
+    uint64_t blocksCompiled = 0;
+    uint64_t nativeInstructions = 0;
+    uint64_t interpretedInstructions = 0;
+
+    Jit(Chip8*);
+    ~Jit();
+
+    bool available();
+    StopReason run(uint32_t);
+    void invalidate(uint16_t, uint16_t);
+    void flush();
+
+private:
+
+    typedef int32_t (*Entry)(Chip8*, const uint8_t*, int32_t);
+
+    //Executable memory
+    uint8_t *buffer = nullptr;
+    uint8_t *emitPtr = nullptr;
+    uint8_t *epilogue = nullptr;
+    Entry enter = nullptr;
+    bool writable = true;
+    bool disabled = false;
+
+    //Native entry point of the block starting at each address
+    //Read by the generated code for indirect jumps
+    const uint8_t *entries[0x10000];
+
+    JitBlock *blocks[0x10000];
+    bool interpretOnly[0x10000];
+    std::vector<JitBlock*> pages[256];
+    std::vector<JitBlock*> allBlocks;
+
+    //Unlinked jumps, by target address
+    std::unordered_map<uint16_t, std::vector<uint8_t*>> pendingLinks;
+
+    void reset();
+    bool protect(bool);
+    JitBlock* compile(uint16_t);
+    void kill(JitBlock*);
+    void link(uint8_t*, uint16_t);
+    void patch(uint8_t*, const uint8_t*);
+
+    //Code emission
+    void emit8(uint8_t);
+    void emit16(uint16_t);
+    void emit32(uint32_t);
+    void emit64(uint64_t);
+    void emitRel32(const uint8_t*);
+    void emitTrampoline();
+    void emitAlu(uint8_t, uint8_t, uint8_t);
+    void emitAluImm(uint8_t, uint8_t, uint8_t);
+    void emitMovImm(uint8_t, uint8_t);
+    void emitLoadByte(uint8_t, uint32_t);
+    void emitStoreByte(uint32_t, uint8_t);
+    void emitZeroExtend(uint8_t, uint8_t);
+    void emitSet(uint8_t, uint8_t);
+    void emitStoreWordImm(uint32_t, uint16_t);
+    void emitStoreAx(uint32_t);
+    void emitJcc(uint8_t, const uint8_t*);
+    uint8_t* emitJmp(const uint8_t*);
+    void emitIndirectJump();
+};
+
+#endif // JIT_HPP_INCLUDED
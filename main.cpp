@@ -23,24 +23,53 @@ SOFTWARE.
 */
 
 #include <iostream>
+#include <iomanip>
 #include <cstdio>
 #include <SDL2/SDL.h>
 #include <ctime>
+#include <chrono>
 #include <cmath>
 #include <string>
 #include <cstring>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <thread>
 #include <unistd.h>
 
 #include "chip8.hpp"
+#include "jit.hpp"
+#include "cfg.hpp"
+#include "renderer.hpp"
+#include "compose.hpp"
+#include "scale.hpp"
+#include "frame.hpp"
+#include "spsc.hpp"
+#include "audio.hpp"
+#include "speaker.hpp"
+#include "pacer.hpp"
 
 #define CYCLES_STEP 5
 #define CYCLES_DEFAULT 200
+#define FRAME_RATE 60
+#define TURBO_SKIP 4
 
 #define ARG_CYCLES "-c"
 #define ARG_MACHINE "-m"
 #define ARG_KEYBOARD "-k"
 #define ARG_PALETTE "-p"
 #define ARG_TEST "-t"
+#define ARG_BENCHMARK "-b"
+#define ARG_CORE "-i"
+#define ARG_JIT "-j"
+#define ARG_BREAKPOINT "-d"
+#define ARG_GRAPH "-g"
+#define ARG_HASHES "-s"
+#define ARG_SCALER "-u"
+#define ARG_AUDIOSYNC "-a"
+#define ARG_LATE "-l"
+#define ARG_TURBO "-f"
 #define ARGLEN 2
 #define ARG_AUTO "auto"
 #define ARG_CHIP8 "chip8"
@@ -49,6 +78,10 @@ SOFTWARE.
 #define ARG_SKYWARD "skyward"
 #define ARG_QWERTY "qwerty"
 #define ARG_AZERTY "azerty"
+#define ARG_CACHED "cached"
+#define ARG_THREADED "threaded"
+#define ARG_CATCHUP "catchup"
+#define ARG_DROP "drop"
 
 #define MACHINE_AUTO 0
 #define MACHINE_CHIP8 1
@@ -64,6 +97,163 @@ SOFTWARE.
 
 using namespace std;
 
+//Input sent from the window to the emulation thread
+enum InputType {
+    INPUT_PRESS,
+    INPUT_RELEASE,
+    INPUT_RESET,
+    INPUT_SLOWER,
+    INPUT_FASTER,
+    INPUT_PAUSE,
+    INPUT_STEP,
+    INPUT_TURBO
+};
+
+struct Input {
+    uint8_t type;
+    uint8_t key;
+};
+
+typedef SpscQueue<Input, 256> InputQueue;
+
+//Emulation thread
+//Runs FRAME_RATE frames per second, applies the inputs sent by the window,
+//queues the frame's sound and publishes each completed frame. Never waits
+//for the display.
+//Frames are paced by the system clock, or with audioSync by the audio
+//device : a frame runs whenever the samples queued drop below one device
+//buffer and one frame, so timers follow the device's sample clock exactly.
+//While fast-forwarding, frames run as fast as the host allows, silently,
+//and only one out of turboSkip is published.
+static void emulate(Chip8 *chip8, TripleBuffer *frames, InputQueue *inputs, Speaker *speaker, Pacer *pacer, bool audioSync, bool turbo, uint32_t turboSkip, atomic<bool> *running) {
+
+    bool paused = false;
+    Input input;
+
+    //Fast-forward speed, measured over half a second
+    uint32_t skipped = 0;
+    uint32_t speedFrames = 0;
+    float speed = 0;
+    chrono::steady_clock::time_point speedStart = chrono::steady_clock::now();
+
+    Audio audio(speaker != nullptr ? speaker->rate : SPEAKER_RATE);
+    vector<int16_t> samples(audio.rate / AUDIO_FRAME_RATE + 1);
+
+    while(running->load(memory_order_acquire)) {
+
+        while(inputs->pop(input)) {
+            switch(input.type) {
+                case INPUT_PRESS: chip8->pressKey(input.key); break;
+                case INPUT_RELEASE: chip8->releaseKey(input.key); break;
+                case INPUT_RESET: chip8->initialize(); break;
+                case INPUT_PAUSE: paused ^= 1; break;
+
+                case INPUT_SLOWER: {
+                    if(chip8->tickRate > CYCLES_STEP)
+                        chip8->tickRate -= CYCLES_STEP;
+                    break;
+                }
+
+                case INPUT_FASTER: {
+                    chip8->tickRate += CYCLES_STEP;
+                    break;
+                }
+
+                case INPUT_STEP: {
+                    uint16_t pc = chip8->pc;
+                    chip8->emulateInstruction();
+                    chip8->printInstruction(chip8->opcode, pc);
+                    break;
+                }
+
+                case INPUT_TURBO: {
+                    turbo ^= 1;
+                    speed = 0;
+                    speedFrames = 0;
+                    speedStart = chrono::steady_clock::now();
+
+                    if(!turbo)
+                        pacer->reset();
+                    break;
+                }
+
+                default: break;
+            }
+        }
+
+        //Emulate cycles
+        if(!paused && !chip8->stopped){
+
+            uint32_t cycles = chip8->tickRate;
+
+            while(cycles > 0) {
+                StopReason reason = chip8->run(cycles);
+                cycles = chip8->cyclesLeft;
+
+                if(reason == STOP_BREAKPOINT) {
+                    cout << "Breakpoint at " << hex << setfill('0') << setw(4) << chip8->pc << dec << endl;
+                    paused = true;
+                    break;
+                }
+
+                //Unknown opcodes are reported by the interpreter, keep going
+                if(reason != STOP_UNKNOWN)
+                    break;
+            }
+        }
+
+        //Sound of the frame, played while the sound timer runs
+        //Paused frames are queued as silence, so the device clock keeps running
+        if(speaker != nullptr && !turbo) {
+            uint32_t count = audio.frameSamples();
+
+            if(!paused && !chip8->stopped)
+                audio.render(chip8, samples.data(), count);
+            else
+                fill(samples.begin(), samples.begin() + count, 0);
+
+            speaker->queue(samples.data(), count);
+        }
+
+        //Update Chip-8 timers
+        chip8 -> updateTimers();
+
+        //Skipped frames leave their dirty rows to the next published one
+        if(!turbo || ++skipped >= turboSkip) {
+            frames->back()->capture(chip8);
+            frames->back()->speed = turbo ? speed : 0;
+            frames->publish();
+            skipped = 0;
+        }
+
+        //Fast-forward : no waiting, measure the speed instead
+        if(turbo) {
+            //Paused frames don't need to go fast
+            if(paused)
+                this_thread::sleep_for(chrono::milliseconds(1000 / FRAME_RATE));
+
+            chrono::duration<float> elapsed = chrono::steady_clock::now() - speedStart;
+            speedFrames++;
+
+            if(elapsed.count() >= 0.5f) {
+                speed = speedFrames / elapsed.count() / FRAME_RATE;
+                speedFrames = 0;
+                speedStart = chrono::steady_clock::now();
+            }
+        }
+        else if(audioSync) {
+            //Wait until the device has played enough, a poll costs nothing next to a frame
+            uint32_t target = speaker->buffer + audio.rate / AUDIO_FRAME_RATE;
+
+            while(speaker->queued() >= target && running->load(memory_order_acquire))
+                this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        else {
+            pacer->wait();
+        }
+    }
+}
+
 int main(int argc, char** argv)
 {
     SDL_Keycode keyBindings[] = {
@@ -89,9 +279,16 @@ int main(int argc, char** argv)
 
     //Emulation properties
     uint8_t keySet = KB_DEFAULT;  // 0-QWERTY 1-AZERTY
-    bool paused = false;          // Emulation paused
     int machine = MACHINE_DEFAULT;// 0: auto 1: chip8 2:schip 3:xochip
     int testCycles = 0;           // Run a set number of cycles for testing
+    int benchFrames = 0;          // Run a set number of frames for benchmarking
+    string graphFile;             // Export the control-flow graph
+    string hashFile;              // Write the screen hash of every benchmark frame
+    const Scaler *scaler = nullptr;// CPU upscaler, GPU scaling only if null
+    bool audioSync = false;       // Pace frames with the audio device instead of the system clock
+    PacerPolicy latePolicy = PACER_CATCHUP;// Deadlines missed by slow frames
+    bool turbo = false;           // Start fast-forwarding
+    int turboSkip = TURBO_SKIP;   // Frames run per frame displayed while fast-forwarding
 
     //Display argument help
     if(argc < 2) {
@@ -100,8 +297,19 @@ int main(int argc, char** argv)
         cout << "  -k [azerty qwerty]    keyboard layout" << endl;
         cout << "  -m [auto chip8 schip xochip]    machine type" << endl;
         cout << "  -c cycles    instructions per frame" << endl;
+        cout << "  -i [cached threaded]    interpreter core" << endl;
+        cout << "  -j    enable the x86-64 recompiler" << endl;
+        cout << "  -u [nearest2 nearest3 nearest4 scale2x scale3x scale4x]    upscale on the CPU" << endl;
+        cout << "  -a    time emulation with the audio device" << endl;
+        cout << "  -l [catchup drop]    run or skip the frames missed after a slow one" << endl;
+        cout << "  -f frames    start fast-forwarding, displaying one frame out of n" << endl;
         cout << " testing : " << endl;
         cout << "  -t cycles    run headless for n cycles and exit" << endl;
+        cout << "  -b frames    run headless for n frames and print emulation speed" << endl;
+        cout << "  -s file    with -b, write the screen hash of every frame to file" << endl;
+        cout << "  -g file    export the control-flow graph (.dot or .json) and exit" << endl;
+        cout << " debugging : " << endl;
+        cout << "  -d address    pause before executing the instruction at address (hex)" << endl;
 
         return 0;
     }
@@ -208,6 +416,151 @@ int main(int argc, char** argv)
                 return 1;
             }
         }
+
+        // Benchmark mode
+        if(strncmp(ARG_BENCHMARK, argv[i], ARGLEN) == 0) {
+
+            if(argc <= i+1) {
+                cout << "ERROR : frames value not provided" << endl;
+                return 1;
+            }
+
+            if(sscanf(argv[i+1], "%d", &benchFrames) != 1) {
+                cout << "ERROR : frames argument must be an integer number" << endl;
+                return 1;
+            }
+        }
+
+        //Control-flow graph export
+        if(strncmp(ARG_GRAPH, argv[i], ARGLEN) == 0) {
+
+            if(argc <= i+1) {
+                cout << "ERROR : graph file not provided" << endl;
+                return 1;
+            }
+
+            graphFile = argv[i+1];
+        }
+
+        //Screen hashes
+        if(strncmp(ARG_HASHES, argv[i], ARGLEN) == 0) {
+
+            if(argc <= i+1) {
+                cout << "ERROR : hash file not provided" << endl;
+                return 1;
+            }
+
+            hashFile = argv[i+1];
+        }
+
+        //Breakpoint
+        if(strncmp(ARG_BREAKPOINT, argv[i], ARGLEN) == 0) {
+            unsigned int address;
+
+            if(argc <= i+1) {
+                cout << "ERROR : breakpoint address not provided" << endl;
+                return 1;
+            }
+
+            if(sscanf(argv[i+1], "%x", &address) != 1 || address > 0xFFFF) {
+                cout << "ERROR : breakpoint address must be a 16-bit hexadecimal number" << endl;
+                return 1;
+            }
+
+            chip8->setBreakpoint(address, true);
+        }
+
+        //Interpreter core
+        if(strncmp(ARG_CORE, argv[i], ARGLEN) == 0) {
+            char *values[] = {(char*)ARG_CACHED, (char*)ARG_THREADED};
+            int cores[] = {CORE_CACHED, CORE_THREADED};
+            bool coreFound = false;
+
+            if(argc <= i+1) {
+                cout << "ERROR : interpreter core not provided" << endl;
+                return 1;
+            }
+
+            for(int j = 0 ; j < 2 ; j++) {
+                if(strncmp(values[j], argv[i+1], strlen(values[j])) == 0) {
+                    chip8->core = cores[j];
+                    coreFound = true;
+                    break;
+                }
+            }
+
+            if(!coreFound){
+                cout << "Unknown interpreter core " << argv[i+1] << endl;
+                return 1;
+            }
+        }
+
+        //CPU upscaler
+        if(strncmp(ARG_SCALER, argv[i], ARGLEN) == 0) {
+
+            if(argc <= i+1) {
+                cout << "ERROR : scaler not provided" << endl;
+                return 1;
+            }
+
+            scaler = findScaler(argv[i+1]);
+
+            if(scaler == nullptr) {
+                cout << "Unknown scaler " << argv[i+1] << endl;
+                return 1;
+            }
+        }
+
+        //Recompiler
+        if(strncmp(ARG_JIT, argv[i], ARGLEN) == 0) {
+            chip8->core = CORE_JIT;
+        }
+
+        //Audio clock
+        if(strncmp(ARG_AUDIOSYNC, argv[i], ARGLEN) == 0) {
+            audioSync = true;
+        }
+
+        //Fast-forward
+        if(strncmp(ARG_TURBO, argv[i], ARGLEN) == 0) {
+
+            if(argc <= i+1) {
+                cout << "ERROR : frames value not provided" << endl;
+                return 1;
+            }
+
+            if(sscanf(argv[i+1], "%d", &turboSkip) != 1 || turboSkip <= 0) {
+                cout << "ERROR : frames argument must be a number greater than 0" << endl;
+                return 1;
+            }
+
+            turbo = true;
+        }
+
+        //Late frames policy
+        if(strncmp(ARG_LATE, argv[i], ARGLEN) == 0) {
+            char *values[] = {(char*)ARG_CATCHUP, (char*)ARG_DROP};
+            PacerPolicy policies[] = {PACER_CATCHUP, PACER_DROP};
+            bool policyFound = false;
+
+            if(argc <= i+1) {
+                cout << "ERROR : late frames policy not provided" << endl;
+                return 1;
+            }
+
+            for(int j = 0 ; j < 2 ; j++) {
+                if(strncmp(values[j], argv[i+1], strlen(values[j])) == 0) {
+                    latePolicy = policies[j];
+                    policyFound = true;
+                    break;
+                }
+            }
+
+            if(!policyFound){
+                cout << "Unknown late frames policy " << argv[i+1] << endl;
+                return 1;
+            }
+        }
     }
 
     switch(machine) {
@@ -216,43 +569,32 @@ int main(int argc, char** argv)
         case MACHINE_AUTO :
         case MACHINE_CHIP8 : {
             //CHIP-8
-            chip8->loadStoreQuirk = false;
-            chip8->shiftQuirk = false;
-            chip8->wrapQuirk = true;
+            chip8->setQuirks(QUIRKS_CHIP8);
             break;
         }
 
         case MACHINE_SCHIP : {
             //SCHIP
-            chip8->loadStoreQuirk = true;
-            chip8->shiftQuirk = true;
-            chip8->hiresClearQuirk = false;
-            chip8->wrapQuirk = true;
+            chip8->setQuirks(QUIRKS_SCHIP);
             break;
         }
 
         case MACHINE_XOCHIP : {
             //XO-CHIP
-            chip8->loadStoreQuirk = false;
-            chip8->shiftQuirk = false;
-            chip8->hiresClearQuirk = true;
-            chip8->wrapQuirk = false;
+            chip8->setQuirks(QUIRKS_XOCHIP);
             break;
         }
 
         case MACHINE_SKYWARD : {
             //XO-CHIP with load quirk enabled
             //Fixes Skyward
-            chip8->loadStoreQuirk = true;
-            chip8->shiftQuirk = false;
-            chip8->hiresClearQuirk = true;
-            chip8->wrapQuirk = false;
+            chip8->setQuirks(QUIRKS_SKYWARD);
             break;
         }
     }
 
 
-    bool running = false;
+    atomic<bool> running(false);
 
     //Load ROM
     if(chip8->loadROM(argv[1]) == 0) {
@@ -261,6 +603,22 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    // Control-flow graph export
+    if (!graphFile.empty()) {
+
+        Cfg cfg(chip8);
+        cfg.build();
+
+        cout << "Control-flow graph : " << dec << cfg.blocks.size() << " blocks, " << cfg.functions.size() << " functions" << endl;
+
+        if(cfg.indirect)
+            cout << "Indirect jumps found, code they reach may be missing" << endl;
+
+        bool dot = graphFile.size() >= 4 && graphFile.compare(graphFile.size() - 4, 4, ".dot") == 0;
+
+        return dot ? cfg.exportDot(graphFile) : cfg.exportJson(graphFile);
+    }
+
     // Headless testing mode
     // Execute set number of cycles and exit
     if (testCycles > 0) {
@@ -269,7 +627,7 @@ int main(int argc, char** argv)
 
         for (int i = 0 ; i < testCycles ; i++) {
 
-            chip8->emulateInstruction();
+            chip8->emulateCycles(1);
 
             // Force timer update
             chip8 -> updateTimers();
@@ -277,13 +635,27 @@ int main(int argc, char** argv)
 
         // Print video output to terminal
         cout << endl << "RESULTS" << endl;
+        cout << "Screen hash : " << hex << setfill('0') << setw(16) << chip8->screenHash() << dec << endl;
+
+        //Each plane goes through the palette kernel with a table of characters
+        vector<uint32_t> screen(SCHIP_WH);
 
         for (int p = 0 ; p < 2 ; p++) {
             cout << "Plane " << (int)p << " :" << endl;
 
+            uint32_t chars[4];
+
+            for (int c = 0 ; c < 4 ; c++)
+                chars[c] = ((c >> p) & 1) ? '0' : '.';
+
+            selectComposeKernel()->compose(chip8->gfx, chars, ~0ull, chip8->nativeLores ? 1 : 2, screen.data());
+
+            //Native lores pixels are printed as 2x2 characters
+            int scale = chip8->nativeLores ? 2 : 1;
+
             for (int i = 0 ; i < SCHIP_H ; i++) {
                 for (int j = 0 ; j < SCHIP_W ; j++) {
-                    cout << ((chip8->gfx[p][j + i * SCHIP_W] > 0) ? "0" : ".");
+                    cout << (char)screen[(i / scale) * SCHIP_W + j / scale];
                 }
 
                 cout << endl;
@@ -295,6 +667,61 @@ int main(int argc, char** argv)
 
     }
 
+    // Benchmark mode
+    // Execute set number of frames and print emulation speed
+    if (benchFrames > 0) {
+
+        cout << "Emulating " << benchFrames << " frames of " << chip8->tickRate << " instructions" << endl;
+
+        //Screen hash of every frame, one per line, for comparing runs
+        ofstream hashes;
+
+        if(!hashFile.empty()) {
+            hashes.open(hashFile);
+
+            if(!hashes) {
+                cout << "ERROR : could not open " << hashFile << endl;
+                return 1;
+            }
+
+            hashes << hex << setfill('0');
+        }
+
+        auto start = chrono::steady_clock::now();
+
+        for (int i = 0 ; i < benchFrames && !chip8->stopped ; i++) {
+            chip8->emulateCycles(chip8->tickRate);
+            chip8->updateTimers();
+
+            if(hashes.is_open())
+                hashes << setw(16) << chip8->screenHash() << '\n';
+        }
+
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        double instructions = (double)benchFrames * chip8->tickRate;
+
+        cout << "Elapsed : " << elapsed.count() << " s" << endl;
+        cout << "Speed : " << instructions / elapsed.count() / 1000000.0 << " MIPS" << endl;
+        cout << "Idle loops skipped : " << chip8->idleLoops << " (" << chip8->idleInstructions << " instructions)" << endl;
+
+        //Superinstruction hits, by FUSE_ identifier
+        const char *fuseNames[FUSE_COUNT] = {"", "ANNN DXYN", "6XNN FX15", "7XNN 3XNN", "FX1E FX65"};
+
+        for (int f = FUSE_NONE + 1 ; f < FUSE_COUNT ; f++)
+            cout << "Superinstruction " << fuseNames[f] << " : " << chip8->fuseHits[f] << endl;
+
+        if(chip8->jit != nullptr) {
+            if(!chip8->jit->available())
+                cout << "Recompiler unavailable on this host, interpreter used" << endl;
+
+            cout << "Blocks compiled : " << chip8->jit->blocksCompiled << endl;
+            cout << "Native instructions : " << chip8->jit->nativeInstructions << endl;
+            cout << "Interpreted instructions : " << chip8->jit->interpretedInstructions << endl;
+        }
+
+        return 0;
+    }
+
     //Window title
     char cyclesBuff[256];
     snprintf(cyclesBuff, 256, "%i", chip8->tickRate);
@@ -310,31 +737,40 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    SDL_Window* window = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1024, 512, SDL_WINDOW_OPENGL);
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    Renderer *display = new Renderer();
     SDL_Event event;
-    SDL_Rect rect;
 
-	//Get window size
-	SDL_GetWindowSize(window, &(rect.w), &(rect.h));
+    if(!display->init(title, 1024, 512, scaler))
+        return 1;
 
-	rect.w /= SCHIP_W;
-	rect.h /= SCHIP_H;
+    //Emulation runs on its own thread, the window and input stay on this one
+    TripleBuffer frames;
+    InputQueue inputs;
 
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
+    //Inputs the queue had no room for yet, sent in order on the next passes so none is lost
+    deque<Input> pending;
+    uint32_t tickRate = chip8->tickRate;
+    float speed = 0;
 
-    SDL_RenderPresent(renderer);
+    //Sound is optional, emulation goes on silently without a device
+    Speaker *speaker = new Speaker();
 
-    Uint32 lastTime, currentTime;
+    if(!speaker->open()) {
+        delete speaker;
+        speaker = nullptr;
+    }
 
-    if(window == NULL) {
-        cout << "Could not initialize window" << endl;
-        return 1;
+    if(audioSync && speaker == nullptr) {
+        cout << "No audio device, timing emulation with the system clock" << endl;
+        audioSync = false;
     }
 
-    lastTime = SDL_GetTicks();
+    Pacer pacer(FRAME_RATE, latePolicy);
+
+    thread emulation(emulate, chip8, &frames, &inputs, speaker, &pacer, audioSync, turbo, turboSkip, &running);
 
+    //The window needs presenting again, even if the screen didn't change
+    bool exposed = true;
 
     while(running) {
 
@@ -348,13 +784,22 @@ int main(int argc, char** argv)
                     break;
                 }
 
+                case SDL_WINDOWEVENT: {
+                    if(event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                        display->resize();
+
+                    if(event.window.event == SDL_WINDOWEVENT_EXPOSED || event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                        exposed = true;
+                    break;
+                }
+
                 case SDL_KEYDOWN: {
                     uint16_t i;
                     SDL_Keycode sdlSym = event.key.keysym.sym;
 
                     for(i = 0 ; i < 16 ; i++) {
                         if(sdlSym == keyBindings[i + 16*keySet] || sdlSym == keyShortcuts[i]) {
-                            chip8 -> keys[i] = true;
+                            pending.push_back({INPUT_PRESS, (uint8_t)i});
                             break;
                         }
                     }
@@ -366,40 +811,15 @@ int main(int argc, char** argv)
                             break;
                         }
 
-                        case SDLK_F2: {
-                            chip8 -> initialize();
-                            break;
-                        }
-
-                        case SDLK_F5: {
-                            if(chip8->tickRate > CYCLES_STEP)
-                                chip8->tickRate -= CYCLES_STEP;
-
-                            snprintf(cyclesBuff, 256, "%i", chip8->tickRate);
-                            title = "CHIP-8 Interpreter - " + (string)cyclesBuff + " instructions per frame";
-                            SDL_SetWindowTitle(window, title.c_str());
-                            break;
-                        }
-
-                        case SDLK_F6: {
-                            chip8->tickRate += CYCLES_STEP;
-
-                            snprintf(cyclesBuff, 256, "%i", chip8->tickRate);
-                            title = "CHIP-8 Interpreter - " + (string)cyclesBuff + " instructions per frame";
-                            SDL_SetWindowTitle(window, title.c_str());
-                            break;
-                        }
-
-
-                        case SDLK_p: {
-                            paused ^= 1;
-                            break;
-                        }
-
-                        case SDLK_o: {
-                            uint16_t pc = chip8->pc;
-                            chip8->emulateInstruction();
-                            chip8->printInstruction(chip8->opcode, pc);
+                        case SDLK_F2: pending.push_back({INPUT_RESET, 0}); break;
+                        case SDLK_F5: pending.push_back({INPUT_SLOWER, 0}); break;
+                        case SDLK_F6: pending.push_back({INPUT_FASTER, 0}); break;
+                        case SDLK_p: pending.push_back({INPUT_PAUSE, 0}); break;
+                        case SDLK_o: pending.push_back({INPUT_STEP, 0}); break;
+                        case SDLK_TAB: {
+                            //Held down, the key repeats : toggle once per press
+                            if(event.key.repeat == 0)
+                                pending.push_back({INPUT_TURBO, 0});
                             break;
                         }
 
@@ -415,13 +835,7 @@ int main(int argc, char** argv)
 
                     for(i = 0 ; i < 16 ; i++) {
                         if(sdlSym == keyBindings[i + 16*keySet] || sdlSym == keyShortcuts[i]) {
-                            chip8->keys[i] = false;
-
-                            if(chip8->waiting) {
-                                chip8->v[chip8->waitRegister] = i;
-                                chip8->waiting = false;
-                            }
-
+                            pending.push_back({INPUT_RELEASE, (uint8_t)i});
                             break;
                         }                            
                     }
@@ -434,75 +848,52 @@ int main(int argc, char** argv)
             }
         }
 
-        //Emulate cycles
-        if(!paused && !chip8->stopped){
+        while(!pending.empty() && inputs.push(pending.front()))
+            pending.pop_front();
 
-            for(int i = 0 ; i < chip8->tickRate ; i++)
-                chip8 -> emulateInstruction();
+        Frame *frame = frames.acquire();
 
+        //Nothing new from the emulation thread
+        if(frame == nullptr) {
+            SDL_Delay(1);
+            continue;
         }
 
-        //Update Chip-8 timers
-        chip8 -> updateTimers();
-
-
-        //Update display
-
-        //Clear surface
-        SDL_SetRenderDrawColor(renderer, chip8->palette[0][0], chip8->palette[0][1], chip8->palette[0][2], 255);
-        SDL_RenderClear(renderer);
-
-        //Color (XO-CHIP)
-        uint8_t col;
-
-        //Memory location
-        uint16_t memLoc = 0;
+        if(frame->tickRate != tickRate || frame->speed != speed) {
+            tickRate = frame->tickRate;
+            speed = frame->speed;
 
-        //Draw pixels
-        for(uint8_t y = 0 ; y < SCHIP_H ; y++) {
-
-            for(uint8_t x = 0 ; x < SCHIP_W ; x++) {
-
-                if(chip8->gfx[0][memLoc] != 0 || chip8->gfx[1][memLoc] != 0) {
-
-                    //Use full palette on XOCHIP, only two colors on other machines
-                    if(machine != MACHINE_CHIP8 && machine != MACHINE_SCHIP)
-                        col = ((chip8->gfx[1][memLoc] << 1) + chip8->gfx[0][memLoc]);
-                    else
-                        col = ((chip8->gfx[1][memLoc] << 1) + chip8->gfx[0][memLoc] > 0) ? 3 : 0;
-
-                    SDL_SetRenderDrawColor(renderer, chip8->palette[col][0], chip8->palette[col][1], chip8->palette[col][2], 255);
-
-                    rect.x = x * rect.w;
-                    rect.y = y * rect.h;
-
-                    SDL_RenderFillRect(renderer, &rect);
-                }
-
-
-
-                memLoc ++;
+            snprintf(cyclesBuff, 256, "%i", tickRate);
+            title = "CHIP-8 Interpreter - " + (string)cyclesBuff + " instructions per frame";
 
+            //Fast-forward speed, once measured
+            if(speed > 0) {
+                snprintf(cyclesBuff, 256, "%.1f", speed);
+                title += " - fast forward x" + (string)cyclesBuff;
             }
 
+            display->setTitle(title);
         }
 
-        //Update display
-        SDL_RenderPresent(renderer);
+        //Update display, unchanged frames are not presented
+        //Use full palette on XOCHIP, only two colors on other machines
+        if(display->draw(frame, machine != MACHINE_CHIP8 && machine != MACHINE_SCHIP) || exposed) {
+            display->present();
+            exposed = false;
+        }
     }
 
+    emulation.join();
 
-    //60fps delay
-    currentTime = SDL_GetTicks();
+    display->printStats();
+    pacer.printStats();
 
-    if(currentTime - lastTime < 1000/60) {
-        SDL_Delay(1000/60 - (currentTime - lastTime));
+    if(speaker != nullptr) {
+        cout << "Audio samples dropped : " << speaker->overruns << ", missing : " << speaker->underruns << endl;
+        delete speaker;
     }
 
-    lastTime = currentTime;
-
-
-    SDL_DestroyWindow(window);
+    delete display;
     SDL_Quit();
 
 
@@ -0,0 +1,135 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "pacer.hpp"
+
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <thread>
+
+#ifdef __unix__
+#include <time.h>
+#endif
+
+Pacer::Pacer(uint32_t rate, PacerPolicy policy) {
+    this->policy = policy;
+    this->rate = rate;
+
+    reset();
+}
+
+void Pacer::reset() {
+    start = now();
+    tick = 0;
+}
+
+//Deadline of a tick, computed from the start so the grid doesn't drift by the rounding of one period
+int64_t Pacer::deadline(uint64_t tick) {
+    return start + (int64_t)(tick * 1000000000 / rate);
+}
+
+//Monotonic clock, in nanoseconds
+int64_t Pacer::now() {
+#ifdef __unix__
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+//Sleep until an absolute time, so a late wake-up doesn't delay the next one
+void Pacer::sleepUntil(int64_t time) {
+#ifdef __unix__
+    timespec t;
+    t.tv_sec = time / 1000000000;
+    t.tv_nsec = time % 1000000000;
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) != 0) {}
+#else
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(time)));
+#endif
+}
+
+void Pacer::wait() {
+
+    tick++;
+    ticks++;
+
+    int64_t next = deadline(tick);
+    int64_t time = now();
+
+    //The frame ended after its deadline : run the next one right away
+    if(time >= next) {
+        overruns++;
+
+        //Deadlines already passed after this one
+        int64_t missed = (int64_t)((uint64_t)(time - start) * rate / 1000000000) - tick;
+
+        if(missed > 0 && (policy == PACER_DROP || missed > PACER_MAX_LATE)) {
+            tick += missed;
+            dropped += missed;
+        }
+
+        return;
+    }
+
+    if(next - time > PACER_SPIN)
+        sleepUntil(next - PACER_SPIN);
+
+    while((time = now()) < next) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    int64_t jitter = time - next;
+
+    waits++;
+    jitterSum += jitter;
+    jitterSquares += (double)jitter * jitter;
+
+    if(jitter > jitterMax)
+        jitterMax = jitter;
+}
+
+void Pacer::printStats() {
+
+    if(ticks == 0)
+        return;
+
+    std::cout << "Frame pacing : " << ticks << " ticks, " << overruns << " late frames, " << dropped << " ticks dropped" << std::endl;
+
+    if(waits == 0)
+        return;
+
+    double mean = jitterSum / waits;
+    double deviation = sqrt(jitterSquares / waits - mean * mean);
+
+    std::cout << "Pacing jitter : " << mean / 1000 << " us mean, " << deviation / 1000 << " us deviation, " << jitterMax / 1000.0 << " us max" << std::endl;
+}
@@ -0,0 +1,89 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef PACER_HPP_INCLUDED
+#define PACER_HPP_INCLUDED
+
+#include <cstdint>
+
+//Sleeps end this early, the rest of the wait is spent polling the clock
+#define PACER_SPIN 1000000
+
+//Deadlines missed before the pacer gives up on catching up
+#define PACER_MAX_LATE 4
+
+//What to do with deadlines missed by a slow frame
+enum PacerPolicy {
+    PACER_CATCHUP, //run the missed ticks back to back
+    PACER_DROP     //skip them, timers lose that time
+};
+
+//Frame pacer
+//Ticks at a fixed rate, on a grid of absolute deadlines so errors never
+//add up. Sleeps until shortly before each deadline, then spins on the
+//monotonic clock for sub-millisecond accuracy. Presentation doesn't
+//depend on it, the display takes frames from the triple buffer on its own.
+class Pacer {
+
+public:
+
+    Pacer(uint32_t, PacerPolicy);
+
+    //Wait for the next tick, from the end of a frame
+    void wait();
+
+    //Restart the grid from now, after frames that weren't paced
+    void reset();
+
+    void printStats();
+
+    PacerPolicy policy;
+
+    //Ticks waited for, frames that ended after their deadline, and deadlines skipped
+    uint64_t ticks = 0;
+    uint64_t overruns = 0;
+    uint64_t dropped = 0;
+
+    //Wake-up delay past the deadline, in nanoseconds, over the ticks that waited
+    uint64_t waits = 0;
+    double jitterSum = 0;
+    double jitterSquares = 0;
+    int64_t jitterMax = 0;
+
+private:
+
+    uint32_t rate;
+
+    //Start of the grid in nanoseconds, and the last tick waited for
+    int64_t start;
+    uint64_t tick;
+
+    int64_t deadline(uint64_t);
+
+    static int64_t now();
+    static void sleepUntil(int64_t);
+};
+
+#endif // PACER_HPP_INCLUDED
@@ -0,0 +1,333 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+//ch8recomp : ahead-of-time recompiler
+//Translates the basic blocks of a ROM into a C++ source file which links
+//against the emulator core and runs headless (see aot.hpp).
+
+#include "chip8.hpp"
+#include "cfg.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <set>
+#include <zlib.h>
+
+//OP_ identifier names, in enum order
+static const char *opNames[OP_COUNT] = {
+    "OP_UNKNOWN", "OP_IGNORE", "OP_00CN", "OP_00DN", "OP_00E0", "OP_00EE", "OP_00FB", "OP_00FC",
+    "OP_00FD", "OP_00FE", "OP_00FF", "OP_1NNN", "OP_2NNN", "OP_3XNN", "OP_4XNN", "OP_5XY0",
+    "OP_5XY2", "OP_5XY3", "OP_6XNN", "OP_7XNN", "OP_8XY0", "OP_8XY1", "OP_8XY2", "OP_8XY3",
+    "OP_8XY4", "OP_8XY5", "OP_8XY6", "OP_8XY7", "OP_8XYE", "OP_9XY0", "OP_ANNN", "OP_BNNN",
+    "OP_CXNN", "OP_DXYN", "OP_EX9E", "OP_EXA1", "OP_F000", "OP_FN01", "OP_F002", "OP_FX07",
+    "OP_FX0A", "OP_FX15", "OP_FX18", "OP_FX1E", "OP_FX29", "OP_FX30", "OP_FX33", "OP_FX3A",
+    "OP_FX55", "OP_FX65", "OP_FX75", "OP_FX85"
+};
+
+//Translated block
+struct Segment {
+    uint16_t start;
+    uint32_t end;
+    uint32_t count;
+    uint16_t jump;
+    std::string code;
+};
+
+static std::string hex(uint32_t value, uint8_t width) {
+    std::stringstream ss;
+    ss << "0x" << std::hex << std::uppercase << std::setfill('0') << std::setw(width) << value;
+
+    return ss.str();
+}
+
+static std::string reg(uint8_t x) {
+    std::stringstream ss;
+    ss << "c.v[" << std::dec << (int)x << "]";
+
+    return ss.str();
+}
+
+//Instructions left to the interpreter
+//BNNN jumps to an address only known at run time, 00FD and FX0A block the
+//interpreter and unknown opcodes are most likely data
+static bool translatable(uint8_t op) {
+    return op != OP_BNNN && op != OP_00FD && op != OP_FX0A && op != OP_UNKNOWN;
+}
+
+//Instructions that write to memory, translated code may have changed
+static bool isStore(uint8_t op) {
+    return op == OP_5XY2 || op == OP_FX33 || op == OP_FX55;
+}
+
+//Condition under which a skip instruction skips
+static std::string skipCondition(const Instruction &inst) {
+    std::stringstream ss;
+
+    switch(inst.op) {
+        case OP_3XNN: ss << reg(inst.x) << " == " << hex(inst.nn, 2); break;
+        case OP_4XNN: ss << reg(inst.x) << " != " << hex(inst.nn, 2); break;
+        case OP_5XY0: ss << reg(inst.x) << " == " << reg(inst.y); break;
+        case OP_9XY0: ss << reg(inst.x) << " != " << reg(inst.y); break;
+        case OP_EX9E: ss << "c.keys[" << reg(inst.x) << " & 0xF]"; break;
+        case OP_EXA1: ss << "!c.keys[" << reg(inst.x) << " & 0xF]"; break;
+        default: return "";
+    }
+
+    return ss.str();
+}
+
+//C++ statement for an instruction that doesn't end a block
+//Instructions without a direct translation call their interpreter handler,
+//which is specialized for the quirks selected at run time
+static std::string statement(const Instruction &inst, uint16_t addr, std::string &decls, std::set<uint16_t> &declared) {
+    std::stringstream ss;
+    std::string x = reg(inst.x);
+    std::string y = reg(inst.y);
+
+    switch(inst.op) {
+        case OP_IGNORE: return "";
+        case OP_6XNN: ss << x << " = " << hex(inst.nn, 2) << ";"; break;
+        case OP_7XNN: ss << x << " += " << hex(inst.nn, 2) << ";"; break;
+        case OP_8XY0: ss << x << " = " << y << ";"; break;
+        case OP_8XY1: ss << x << " |= " << y << ";"; break;
+        case OP_8XY2: ss << x << " &= " << y << ";"; break;
+        case OP_8XY3: ss << x << " ^= " << y << ";"; break;
+
+        case OP_8XY4:
+            ss << "{ uint8_t carry = (" << x << " + " << y << ") > 0xFF; " << x << " += " << y << "; c.v[15] = carry; }";
+            break;
+
+        case OP_8XY5:
+            ss << "{ uint8_t carry = " << y << " <= " << x << "; " << x << " -= " << y << "; c.v[15] = carry; }";
+            break;
+
+        case OP_8XY7:
+            ss << "{ uint8_t carry = " << x << " <= " << y << "; " << x << " = " << y << " - " << x << "; c.v[15] = carry; }";
+            break;
+
+        case OP_ANNN: ss << "c.I = " << hex(inst.nnn, 3) << ";"; break;
+        case OP_F000: ss << "c.I = " << hex(inst.nnn, 4) << ";"; break;
+        case OP_FX07: ss << x << " = c.delayTimer;"; break;
+        case OP_FX15: ss << "c.delayTimer = " << x << ";"; break;
+        case OP_FX18: ss << "c.soundTimer = " << x << ";"; break;
+        case OP_FX29: ss << "c.I = " << x << " * 5;"; break;
+        case OP_FX30: ss << "c.I = 80 + " << x << " * 10;"; break;
+
+        default: {
+            std::string name = "i_" + hex(addr, 4).substr(2);
+            std::stringstream decl;
+
+            //Blocks can overlap when code is entered at different alignments
+            if(!declared.insert(addr).second) {
+                ss << "c.handlers[" << opNames[inst.op] << "](c, " << name << ");";
+                break;
+            }
+
+            decl << "static const Instruction " << name << " = {nullptr, " << hex(inst.opcode, 4) << ", " << hex(inst.nnn, 4) << ", "
+                << std::dec << (int)inst.x << ", " << (int)inst.y << ", " << (int)inst.n << ", " << (int)inst.nn << ", "
+                << opNames[inst.op] << "};" << std::endl;
+
+            decls += decl.str();
+            ss << "c.handlers[" << opNames[inst.op] << "](c, " << name << ");";
+            break;
+        }
+    }
+
+    return ss.str();
+}
+
+int main(int argc, char **argv) {
+
+    if(argc < 3) {
+        std::cout << "usage: ch8recomp rom_file output_file" << std::endl;
+        std::cout << " translates rom_file into a C++ source file, to be built with aot.cpp and the emulator core" << std::endl;
+
+        return 0;
+    }
+
+    Chip8 *chip8 = new Chip8();
+
+    if(chip8->loadROM(argv[1]) != 0)
+        return 1;
+
+    Cfg cfg(chip8);
+    cfg.build();
+
+    std::string decls;
+    std::set<uint16_t> declared;
+    std::vector<Segment> segments;
+
+    for(auto &it : cfg.blocks) {
+        CfgBlock &block = it.second;
+
+        Segment segment;
+        bool open = false;
+        uint16_t lastOpcode = 0;
+
+        for(uint32_t addr = block.start ; addr < block.end ; ) {
+
+            const Instruction &inst = chip8->cache[addr];
+            uint32_t next = addr + ((inst.op == OP_F000) ? 4 : 2);
+
+            //Close the current block, the interpreter takes over
+            if(!translatable(inst.op)) {
+                if(open) {
+                    segment.code += "    c.opcode = " + hex(lastOpcode, 4) + ";\n";
+                    segment.code += "    return " + hex(addr, 4) + ";\n";
+                    segments.push_back(segment);
+                    open = false;
+                }
+
+                addr = next;
+                continue;
+            }
+
+            if(!open) {
+                segment.start = addr;
+                segment.count = 0;
+                segment.jump = 0;
+                segment.code = "";
+                open = true;
+            }
+
+            segment.count ++;
+            segment.end = next;
+            lastOpcode = inst.opcode;
+
+            std::string opcode = "    c.opcode = " + hex(inst.opcode, 4) + ";\n";
+            std::string condition = skipCondition(inst);
+
+            if(inst.op == OP_1NNN) {
+                segment.jump = addr;
+                segment.code += opcode;
+                segment.code += "    return " + hex(inst.nnn, 4) + ";\n";
+            }
+            else if(inst.op == OP_2NNN) {
+                segment.code += opcode;
+                segment.code += "    c.stck[c.sp] = " + hex(next, 4) + ";\n";
+                segment.code += "    c.sp ++;\n";
+                segment.code += "    return " + hex(inst.nnn, 4) + ";\n";
+            }
+            else if(inst.op == OP_00EE) {
+                segment.code += opcode;
+                segment.code += "    c.sp --;\n";
+                segment.code += "    return c.stck[c.sp];\n";
+            }
+            else if(!condition.empty()) {
+                //Skips jump over both words of F000 NNNN
+                uint32_t skip = next + 2;
+
+                if(((chip8->memory[next] << 8) | chip8->memory[next + 1]) == 0xF000)
+                    skip += 2;
+
+                segment.end = next + 2;
+                segment.code += opcode;
+                segment.code += "    return (" + condition + ") ? " + hex(skip, 4) + " : " + hex(next, 4) + ";\n";
+            }
+            else {
+                std::string line = statement(inst, addr, decls, declared);
+
+                if(!line.empty())
+                    segment.code += "    " + line + "\n";
+
+                if(!isStore(inst.op)) {
+                    addr = next;
+                    continue;
+                }
+
+                //The store may have invalidated the code that follows
+                segment.code += opcode;
+                segment.code += "    return " + hex(next, 4) + ";\n";
+            }
+
+            segments.push_back(segment);
+            open = false;
+            addr = next;
+        }
+
+        //Fallthrough into the next block
+        if(open) {
+            segment.code += "    c.opcode = " + hex(lastOpcode, 4) + ";\n";
+            segment.code += "    return " + hex(block.end, 4) + ";\n";
+            segments.push_back(segment);
+        }
+    }
+
+    std::ofstream file(argv[2]);
+
+    if(!file) {
+        std::cout << "Could not write file " << argv[2] << std::endl;
+        return 1;
+    }
+
+    uint32_t crc = crc32(0, (Bytef *) chip8->memory + 0x200, chip8->romSize);
+
+    file << "//Translated by ch8recomp from " << argv[1] << std::endl;
+    file << "//Build with aot.cpp, chip8.cpp, jit.cpp and scroll.cpp" << std::endl;
+    file << std::endl;
+    file << "#include \"aot.hpp\"" << std::endl;
+    file << std::endl;
+
+    //ROM contents, checked before using a block
+    file << "static const uint8_t image[] = {";
+
+    for(uint32_t i = 0 ; i < chip8->romSize ; i++)
+        file << ((i % 16 == 0) ? "\n    " : " ") << hex(chip8->memory[0x200 + i], 2) << ",";
+
+    file << "\n};" << std::endl << std::endl;
+
+    file << decls << std::endl;
+
+    for(Segment &segment : segments) {
+        file << "static uint16_t b_" << hex(segment.start, 4).substr(2) << "(Chip8 &c) {" << std::endl;
+        file << segment.code;
+        file << "}" << std::endl << std::endl;
+    }
+
+    file << "static const AotBlock blocks[] = {" << std::endl;
+
+    for(Segment &segment : segments)
+        file << "    {" << hex(segment.start, 4) << ", " << hex(segment.end, 4) << ", " << std::dec << segment.count
+            << ", " << hex(segment.jump, 4) << ", &b_" << hex(segment.start, 4).substr(2) << "}," << std::endl;
+
+    file << "};" << std::endl << std::endl;
+
+    file << "static const AotProgram program = {\"" << argv[1] << "\", " << hex(crc, 8) << ", image, "
+        << std::dec << chip8->romSize << ", blocks, " << segments.size() << "};" << std::endl << std::endl;
+
+    file << "int main(int argc, char **argv) {" << std::endl;
+    file << "    return aotMain(argc, argv, &program);" << std::endl;
+    file << "}" << std::endl;
+
+    std::cout << std::dec << "Translated " << segments.size() << " blocks from " << cfg.blocks.size() << " basic blocks" << std::endl;
+
+    if(cfg.indirect)
+        std::cout << "Program uses indirect jumps, code only they reach is left to the interpreter" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,228 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "renderer.hpp"
+
+#include <iostream>
+
+Renderer::~Renderer() {
+    if(texture != nullptr)
+        SDL_DestroyTexture(texture);
+
+    if(renderer != nullptr)
+        SDL_DestroyRenderer(renderer);
+
+    if(window != nullptr)
+        SDL_DestroyWindow(window);
+}
+
+//Create the window, renderer and texture
+//The texture holds the screen upscaled by scaler, if there is one
+bool Renderer::init(std::string title, int width, int height, const Scaler *scaler) {
+
+    this->scaler = scaler;
+
+    uint32_t factor = (scaler != nullptr) ? scaler->factor : 1;
+
+    if(scaler != nullptr)
+        scaled.resize(SCHIP_WH * factor * factor);
+
+    window = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+
+    if(window == NULL) {
+        std::cout << "Could not initialize window" << std::endl;
+        return false;
+    }
+
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+
+    if(renderer == NULL) {
+        std::cout << "Could not initialize renderer : " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, SCHIP_W * factor, SCHIP_H * factor);
+
+    if(texture == NULL) {
+        std::cout << "Could not create texture : " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    SDL_RenderPresent(renderer);
+
+    resize();
+
+    return true;
+}
+
+void Renderer::setTitle(std::string title) {
+    SDL_SetWindowTitle(window, title.c_str());
+}
+
+//Fit the screen to the window, call when its size changes
+void Renderer::resize() {
+    int width, height;
+
+    SDL_GetRendererOutputSize(renderer, &width, &height);
+
+    if(width > height * 2) {
+        viewport.h = height;
+        viewport.w = height * 2;
+    }
+    else {
+        viewport.w = width;
+        viewport.h = width / 2;
+    }
+
+    viewport.x = (width - viewport.w) / 2;
+    viewport.y = (height - viewport.h) / 2;
+}
+
+//Upload the given rows to the texture, one update per run of rows
+void Renderer::upload(uint64_t rows) {
+
+    uint8_t y = 0;
+
+    while(y < SCHIP_H) {
+        if(((rows >> y) & 1) == 0) {
+            y++;
+            continue;
+        }
+
+        uint8_t first = y;
+
+        while(y < SCHIP_H && ((rows >> y) & 1) != 0)
+            y++;
+
+        SDL_Rect rect = {0, first, nativeLores ? CHIP_W : SCHIP_W, y - first};
+        SDL_UpdateTexture(texture, &rect, pixels + first * SCHIP_W, SCHIP_W * sizeof(uint32_t));
+    }
+}
+
+//Update the texture with a new frame
+//XO-CHIP uses the full palette, other machines only two colors
+//Returns false when the frame looks the same as the texture, which then doesn't need presenting
+bool Renderer::draw(const Frame *frame, bool fullPalette) {
+
+    uint64_t rows = frame->dirtyRows;
+    bool changed = false;
+
+    //Frames were skipped since the last one, redraw everything
+    if(frame->sequence != sequence + 1)
+        rows = ~0ull;
+
+    sequence = frame->sequence;
+
+    //Resolution changed, the texture holds the other layout
+    if(frame->nativeLores != nativeLores) {
+        nativeLores = frame->nativeLores;
+        rows = ~0ull;
+        changed = true;
+    }
+
+    for(uint8_t i = 0 ; i < 4 ; i++) {
+        uint8_t col = (fullPalette || i == 0) ? i : 3;
+        uint32_t color = (frame->palette[col][0] << 24) | (frame->palette[col][1] << 16) | (frame->palette[col][2] << 8) | 0xFF;
+
+        //Every pixel may have changed color
+        if(color != colors[i]) {
+            colors[i] = color;
+            rows = ~0ull;
+            changed = true;
+        }
+    }
+
+    //Same planes as the texture, even if rows were drawn over (e.g. a sprite erased and drawn back)
+    if(!changed && frame->hash == hash)
+        return false;
+
+    hash = frame->hash;
+
+    if(nativeLores)
+        rows &= (1ull << CHIP_H) - 1;
+
+    if(rows == 0)
+        return true;
+
+    uint32_t f = (scaler != nullptr) ? scaler->factor : 1;
+    uint32_t w = nativeLores ? CHIP_W : SCHIP_W;
+    uint32_t h = nativeLores ? CHIP_H : SCHIP_H;
+
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    composer->compose(frame->gfx, colors, rows, nativeLores ? 1 : 2, pixels);
+
+    uint64_t composed = SDL_GetPerformanceCounter();
+
+    if(scaler != nullptr)
+        scaler->scale(pixels, w, h, SCHIP_W, scaled.data(), SCHIP_W * f);
+
+    uint64_t scaledTime = SDL_GetPerformanceCounter();
+
+    //Scalers read neighbouring rows, so the whole scaled screen is uploaded
+    if(scaler != nullptr) {
+        SDL_Rect rect = {0, 0, (int)(w * f), (int)(h * f)};
+        SDL_UpdateTexture(texture, &rect, scaled.data(), SCHIP_W * f * sizeof(uint32_t));
+    }
+    else {
+        upload(rows);
+    }
+
+    composeTicks += composed - start;
+    scaleTicks += scaledTime - composed;
+    uploadTicks += SDL_GetPerformanceCounter() - scaledTime;
+    framesDrawn++;
+
+    return true;
+}
+
+//Show the texture, waits for vsync
+void Renderer::present() {
+    int f = (scaler != nullptr) ? scaler->factor : 1;
+    SDL_Rect screen = {0, 0, (nativeLores ? CHIP_W : SCHIP_W) * f, (nativeLores ? CHIP_H : SCHIP_H) * f};
+
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, &screen, &viewport);
+    SDL_RenderPresent(renderer);
+}
+
+//Average cost of each stage per drawn frame
+void Renderer::printStats() {
+
+    if(framesDrawn == 0)
+        return;
+
+    double us = 1000000.0 / SDL_GetPerformanceFrequency() / framesDrawn;
+
+    std::cout << "Frames drawn : " << framesDrawn << std::endl;
+    std::cout << "Compose : " << composeTicks * us << " us per frame (" << composer->name << ")" << std::endl;
+
+    if(scaler != nullptr)
+        std::cout << "Scale : " << scaleTicks * us << " us per frame (" << scaler->name << ")" << std::endl;
+
+    std::cout << "Upload : " << uploadTicks * us << " us per frame" << std::endl;
+}
@@ -0,0 +1,100 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef RENDERER_HPP_INCLUDED
+#define RENDERER_HPP_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <SDL2/SDL.h>
+
+#include "chip8.hpp"
+#include "frame.hpp"
+#include "compose.hpp"
+#include "scale.hpp"
+
+//SDL display
+//Bitplanes are converted to RGBA through the palette, uploaded to a
+//SCHIP_W x SCHIP_H streaming texture, and scaled to the window by the GPU.
+//Native lores screens only use its top-left CHIP_W x CHIP_H corner.
+//With a CPU scaler, the converted screen is upscaled before the upload and
+//the texture is that many times larger.
+//The screen keeps its 2:1 aspect ratio, centered in the window.
+//Only the rows the core marked as dirty are converted and uploaded, and
+//frames with the same planes as the last one are not drawn at all.
+//Frames come from the emulation thread, the renderer only runs on the
+//thread that owns the window.
+class Renderer {
+
+public:
+
+    SDL_Window *window = nullptr;
+    SDL_Renderer *renderer = nullptr;
+    SDL_Texture *texture = nullptr;
+
+    ~Renderer();
+
+    bool init(std::string, int, int, const Scaler*);
+    void setTitle(std::string);
+    void resize();
+    bool draw(const Frame*, bool);
+    void present();
+    void printStats();
+
+private:
+
+    //RGBA8888 pixels, kept between frames
+    uint32_t pixels[SCHIP_WH];
+
+    //Colors of the last frame, for each pixel value
+    uint32_t colors[4] = {};
+
+    //Last frame drawn, the rows of skipped frames are unknown
+    uint64_t sequence = 0;
+
+    //Layout and hash of the texture's contents
+    bool nativeLores = false;
+    uint64_t hash = 0;
+
+    const ComposeKernel *composer = selectComposeKernel();
+
+    //CPU scaler, nullptr to leave scaling to the GPU
+    const Scaler *scaler = nullptr;
+    std::vector<uint32_t> scaled;
+
+    //Area of the window the screen is copied to
+    SDL_Rect viewport = {};
+
+    //Frames drawn, and time spent in each stage, in performance counter ticks
+    uint64_t framesDrawn = 0;
+    uint64_t composeTicks = 0;
+    uint64_t scaleTicks = 0;
+    uint64_t uploadTicks = 0;
+
+    void upload(uint64_t);
+};
+
+#endif // RENDERER_HPP_INCLUDED
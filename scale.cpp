@@ -0,0 +1,312 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "scale.hpp"
+
+#include <cstring>
+#include <vector>
+
+#ifdef SCALE_X64
+#include <immintrin.h>
+#endif
+
+//Neighbours of pixel E :
+//  A B C
+//  D E F
+//  G H I
+//Pixels past the edges repeat the edge pixels.
+
+//Integer nearest neighbour, each source row is scaled once and copied factor - 1 times
+template<uint32_t factor>
+static void nearestScalar(const uint32_t *src, uint32_t width, uint32_t height, uint32_t srcPitch, uint32_t *dst, uint32_t dstPitch) {
+
+    for(uint32_t y = 0 ; y < height ; y++) {
+        const uint32_t *in = src + y * srcPitch;
+        uint32_t *out = dst + y * factor * dstPitch;
+
+        for(uint32_t x = 0 ; x < width ; x++)
+            for(uint32_t i = 0 ; i < factor ; i++)
+                out[x * factor + i] = in[x];
+
+        for(uint32_t i = 1 ; i < factor ; i++)
+            memcpy(out + i * dstPitch, out, width * factor * sizeof(uint32_t));
+    }
+}
+
+static void scale2xScalar(const uint32_t *src, uint32_t width, uint32_t height, uint32_t srcPitch, uint32_t *dst, uint32_t dstPitch) {
+
+    for(uint32_t y = 0 ; y < height ; y++) {
+        const uint32_t *up = src + (y > 0 ? y - 1 : 0) * srcPitch;
+        const uint32_t *row = src + y * srcPitch;
+        const uint32_t *down = src + (y + 1 < height ? y + 1 : y) * srcPitch;
+        uint32_t *out0 = dst + 2 * y * dstPitch;
+        uint32_t *out1 = out0 + dstPitch;
+
+        for(uint32_t x = 0 ; x < width ; x++) {
+            uint32_t B = up[x], H = down[x], E = row[x];
+            uint32_t D = row[x > 0 ? x - 1 : 0];
+            uint32_t F = row[x + 1 < width ? x + 1 : x];
+
+            if(B != H && D != F) {
+                out0[2 * x] = D == B ? D : E;
+                out0[2 * x + 1] = B == F ? F : E;
+                out1[2 * x] = D == H ? D : E;
+                out1[2 * x + 1] = H == F ? F : E;
+            }
+            else {
+                out0[2 * x] = out0[2 * x + 1] = out1[2 * x] = out1[2 * x + 1] = E;
+            }
+        }
+    }
+}
+
+static void scale3xScalar(const uint32_t *src, uint32_t width, uint32_t height, uint32_t srcPitch, uint32_t *dst, uint32_t dstPitch) {
+
+    for(uint32_t y = 0 ; y < height ; y++) {
+        const uint32_t *up = src + (y > 0 ? y - 1 : 0) * srcPitch;
+        const uint32_t *row = src + y * srcPitch;
+        const uint32_t *down = src + (y + 1 < height ? y + 1 : y) * srcPitch;
+        uint32_t *out0 = dst + 3 * y * dstPitch;
+        uint32_t *out1 = out0 + dstPitch;
+        uint32_t *out2 = out1 + dstPitch;
+
+        for(uint32_t x = 0 ; x < width ; x++) {
+            uint32_t l = x > 0 ? x - 1 : 0;
+            uint32_t r = x + 1 < width ? x + 1 : x;
+            uint32_t A = up[l], B = up[x], C = up[r];
+            uint32_t D = row[l], E = row[x], F = row[r];
+            uint32_t G = down[l], H = down[x], I = down[r];
+            uint32_t *o0 = out0 + 3 * x, *o1 = out1 + 3 * x, *o2 = out2 + 3 * x;
+
+            if(B != H && D != F) {
+                o0[0] = D == B ? D : E;
+                o0[1] = (D == B && E != C) || (B == F && E != A) ? B : E;
+                o0[2] = B == F ? F : E;
+                o1[0] = (D == B && E != G) || (D == H && E != A) ? D : E;
+                o1[1] = E;
+                o1[2] = (B == F && E != I) || (H == F && E != C) ? F : E;
+                o2[0] = D == H ? D : E;
+                o2[1] = (D == H && E != I) || (H == F && E != G) ? H : E;
+                o2[2] = H == F ? F : E;
+            }
+            else {
+                o0[0] = o0[1] = o0[2] = o1[0] = o1[1] = o1[2] = o2[0] = o2[1] = o2[2] = E;
+            }
+        }
+    }
+}
+
+//Scale2x of Scale2x, through an intermediate image
+template<ScaleFunc scale2x>
+static void scale4x(const uint32_t *src, uint32_t width, uint32_t height, uint32_t srcPitch, uint32_t *dst, uint32_t dstPitch) {
+    static thread_local std::vector<uint32_t> twice;
+
+    twice.resize(4 * width * height);
+
+    scale2x(src, width, height, srcPitch, twice.data(), 2 * width);
+    scale2x(twice.data(), 2 * width, 2 * height, 2 * width, dst, dstPitch);
+}
+
+const Scaler scalersScalar[SCALER_COUNT] = {
+    {"nearest2", 2, &nearestScalar<2>},
+    {"nearest3", 3, &nearestScalar<3>},
+    {"nearest4", 4, &nearestScalar<4>},
+    {"scale2x", 2, &scale2xScalar},
+    {"scale3x", 3, &scale3xScalar},
+    {"scale4x", 4, &scale4x<&scale2xScalar>}
+};
+
+#ifdef SCALE_X64
+
+//SSE2, four source pixels per register
+//Comparisons give whole-pixel masks, and selections are AND/ANDNOT/OR.
+//Left and right neighbours are the row's register shifted by one pixel,
+//with the pixel from the previous or next register shifted in.
+
+static inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+//mask && a != b
+static inline __m128i unless(__m128i mask, __m128i a, __m128i b) {
+    return _mm_andnot_si128(_mm_cmpeq_epi32(a, b), mask);
+}
+
+//Pixels left and right of the four at x
+static inline __m128i leftOf(const uint32_t *row, uint32_t x, __m128i pixels) {
+    __m128i previous = (x > 0) ? _mm_loadu_si128((const __m128i*)(row + x - 4)) : _mm_shuffle_epi32(pixels, 0x00);
+    return _mm_or_si128(_mm_slli_si128(pixels, 4), _mm_srli_si128(previous, 12));
+}
+
+static inline __m128i rightOf(const uint32_t *row, uint32_t x, uint32_t width, __m128i pixels) {
+    __m128i next = (x + 4 < width) ? _mm_loadu_si128((const __m128i*)(row + x + 4)) : _mm_shuffle_epi32(pixels, 0xFF);
+    return _mm_or_si128(_mm_srli_si128(pixels, 4), _mm_slli_si128(next, 12));
+}
+
+//Interleave three registers into 12 pixels : a0 b0 c0 a1 b1 c1 ...
+static inline void store3(uint32_t *out, __m128i a, __m128i b, __m128i c) {
+    __m128 abLo = _mm_castsi128_ps(_mm_unpacklo_epi32(a, b));
+    __m128 abHi = _mm_castsi128_ps(_mm_unpackhi_epi32(a, b));
+    __m128 bcLo = _mm_castsi128_ps(_mm_unpacklo_epi32(b, c));
+    __m128 bcHi = _mm_castsi128_ps(_mm_unpackhi_epi32(b, c));
+    __m128 caLo = _mm_castsi128_ps(_mm_unpacklo_epi32(c, a));
+    __m128 caHi = _mm_castsi128_ps(_mm_unpackhi_epi32(c, a));
+
+    _mm_storeu_ps((float*)out, _mm_shuffle_ps(abLo, caLo, _MM_SHUFFLE(3, 0, 1, 0)));
+    _mm_storeu_ps((float*)out + 4, _mm_shuffle_ps(bcLo, abHi, _MM_SHUFFLE(1, 0, 3, 2)));
+    _mm_storeu_ps((float*)out + 8, _mm_shuffle_ps(caHi, bcHi, _MM_SHUFFLE(3, 2, 3, 0)));
+}
+
+template<uint32_t factor>
+static void nearestSse2(const uint32_t *src, uint32_t width, uint32_t height, uint32_t srcPitch, uint32_t *dst, uint32_t dstPitch) {
+
+    for(uint32_t y = 0 ; y < height ; y++) {
+        const uint32_t *in = src + y * srcPitch;
+        uint32_t *out = dst + y * factor * dstPitch;
+
+        for(uint32_t x = 0 ; x < width ; x += 4) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(in + x));
+            __m128i *o = (__m128i*)(out + x * factor);
+
+            if(factor == 2) {
+                _mm_storeu_si128(o, _mm_unpacklo_epi32(p, p));
+                _mm_storeu_si128(o + 1, _mm_unpackhi_epi32(p, p));
+            }
+            else if(factor == 3) {
+                store3((uint32_t*)o, p, p, p);
+            }
+            else {
+                _mm_storeu_si128(o, _mm_shuffle_epi32(p, 0x00));
+                _mm_storeu_si128(o + 1, _mm_shuffle_epi32(p, 0x55));
+                _mm_storeu_si128(o + 2, _mm_shuffle_epi32(p, 0xAA));
+                _mm_storeu_si128(o + 3, _mm_shuffle_epi32(p, 0xFF));
+            }
+        }
+
+        for(uint32_t i = 1 ; i < factor ; i++)
+            memcpy(out + i * dstPitch, out, width * factor * sizeof(uint32_t));
+    }
+}
+
+static void scale2xSse2(const uint32_t *src, uint32_t width, uint32_t height, uint32_t srcPitch, uint32_t *dst, uint32_t dstPitch) {
+
+    const __m128i ones = _mm_set1_epi32(-1);
+
+    for(uint32_t y = 0 ; y < height ; y++) {
+        const uint32_t *up = src + (y > 0 ? y - 1 : 0) * srcPitch;
+        const uint32_t *row = src + y * srcPitch;
+        const uint32_t *down = src + (y + 1 < height ? y + 1 : y) * srcPitch;
+        uint32_t *out0 = dst + 2 * y * dstPitch;
+        uint32_t *out1 = out0 + dstPitch;
+
+        for(uint32_t x = 0 ; x < width ; x += 4) {
+            __m128i E = _mm_loadu_si128((const __m128i*)(row + x));
+            __m128i B = _mm_loadu_si128((const __m128i*)(up + x));
+            __m128i H = _mm_loadu_si128((const __m128i*)(down + x));
+            __m128i D = leftOf(row, x, E);
+            __m128i F = rightOf(row, x, width, E);
+
+            //B != H && D != F
+            __m128i edge = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F)), ones);
+
+            __m128i E0 = select(_mm_and_si128(edge, _mm_cmpeq_epi32(D, B)), D, E);
+            __m128i E1 = select(_mm_and_si128(edge, _mm_cmpeq_epi32(B, F)), F, E);
+            __m128i E2 = select(_mm_and_si128(edge, _mm_cmpeq_epi32(D, H)), D, E);
+            __m128i E3 = select(_mm_and_si128(edge, _mm_cmpeq_epi32(H, F)), F, E);
+
+            _mm_storeu_si128((__m128i*)(out0 + 2 * x), _mm_unpacklo_epi32(E0, E1));
+            _mm_storeu_si128((__m128i*)(out0 + 2 * x + 4), _mm_unpackhi_epi32(E0, E1));
+            _mm_storeu_si128((__m128i*)(out1 + 2 * x), _mm_unpacklo_epi32(E2, E3));
+            _mm_storeu_si128((__m128i*)(out1 + 2 * x + 4), _mm_unpackhi_epi32(E2, E3));
+        }
+    }
+}
+
+static void scale3xSse2(const uint32_t *src, uint32_t width, uint32_t height, uint32_t srcPitch, uint32_t *dst, uint32_t dstPitch) {
+
+    const __m128i ones = _mm_set1_epi32(-1);
+
+    for(uint32_t y = 0 ; y < height ; y++) {
+        const uint32_t *up = src + (y > 0 ? y - 1 : 0) * srcPitch;
+        const uint32_t *row = src + y * srcPitch;
+        const uint32_t *down = src + (y + 1 < height ? y + 1 : y) * srcPitch;
+        uint32_t *out0 = dst + 3 * y * dstPitch;
+        uint32_t *out1 = out0 + dstPitch;
+        uint32_t *out2 = out1 + dstPitch;
+
+        for(uint32_t x = 0 ; x < width ; x += 4) {
+            __m128i B = _mm_loadu_si128((const __m128i*)(up + x));
+            __m128i E = _mm_loadu_si128((const __m128i*)(row + x));
+            __m128i H = _mm_loadu_si128((const __m128i*)(down + x));
+            __m128i A = leftOf(up, x, B), C = rightOf(up, x, width, B);
+            __m128i D = leftOf(row, x, E), F = rightOf(row, x, width, E);
+            __m128i G = leftOf(down, x, H), I = rightOf(down, x, width, H);
+
+            __m128i edge = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F)), ones);
+            __m128i DB = _mm_and_si128(edge, _mm_cmpeq_epi32(D, B));
+            __m128i BF = _mm_and_si128(edge, _mm_cmpeq_epi32(B, F));
+            __m128i DH = _mm_and_si128(edge, _mm_cmpeq_epi32(D, H));
+            __m128i HF = _mm_and_si128(edge, _mm_cmpeq_epi32(H, F));
+
+            __m128i E1 = select(_mm_or_si128(unless(DB, E, C), unless(BF, E, A)), B, E);
+            __m128i E3 = select(_mm_or_si128(unless(DB, E, G), unless(DH, E, A)), D, E);
+            __m128i E5 = select(_mm_or_si128(unless(BF, E, I), unless(HF, E, C)), F, E);
+            __m128i E7 = select(_mm_or_si128(unless(DH, E, I), unless(HF, E, G)), H, E);
+
+            store3(out0 + 3 * x, select(DB, D, E), E1, select(BF, F, E));
+            store3(out1 + 3 * x, E3, E, E5);
+            store3(out2 + 3 * x, select(DH, D, E), E7, select(HF, F, E));
+        }
+    }
+}
+
+const Scaler scalersSse2[SCALER_COUNT] = {
+    {"nearest2", 2, &nearestSse2<2>},
+    {"nearest3", 3, &nearestSse2<3>},
+    {"nearest4", 4, &nearestSse2<4>},
+    {"scale2x", 2, &scale2xSse2},
+    {"scale3x", 3, &scale3xSse2},
+    {"scale4x", 4, &scale4x<&scale2xSse2>}
+};
+
+#endif
+
+const Scaler* findScaler(std::string name) {
+
+    const Scaler *scalers = scalersScalar;
+
+#ifdef SCALE_X64
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("sse2"))
+        scalers = scalersSse2;
+#endif
+
+    for(uint32_t i = 0 ; i < SCALER_COUNT ; i++)
+        if(name == scalers[i].name)
+            return &scalers[i];
+
+    return nullptr;
+}
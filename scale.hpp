@@ -0,0 +1,61 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef SCALE_HPP_INCLUDED
+#define SCALE_HPP_INCLUDED
+
+#include <cstdint>
+#include <string>
+
+//Vector kernels are built for x86-64 and picked at run time
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SCALE_X64
+#endif
+
+//Pixel-art upscaling of a composed RGBA screen
+//Arguments : source, width, height, source pitch, destination, destination pitch.
+//Pitches are in pixels, widths must be multiples of 4.
+typedef void (*ScaleFunc)(const uint32_t*, uint32_t, uint32_t, uint32_t, uint32_t*, uint32_t);
+
+struct Scaler {
+    const char *name;
+    uint32_t factor;
+    ScaleFunc scale;
+};
+
+//nearest2, nearest3, nearest4 : integer nearest neighbour
+//scale2x, scale3x : Scale2x / Scale3x (EPX), scale4x : Scale2x applied twice
+#define SCALER_COUNT 6
+
+extern const Scaler scalersScalar[SCALER_COUNT];
+
+#ifdef SCALE_X64
+extern const Scaler scalersSse2[SCALER_COUNT];
+#endif
+
+//Fastest implementation of the named scaler, nullptr if there is none
+const Scaler* findScaler(std::string);
+
+#endif // SCALE_HPP_INCLUDED
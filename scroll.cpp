@@ -0,0 +1,129 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "scroll.hpp"
+#include "chip8.hpp"
+
+#ifdef SCROLL_X64
+#include <immintrin.h>
+#endif
+
+//Rows hold the leftmost pixel in the top bit of their first word,
+//so scrolling left shifts a row towards the top bits
+
+static void scalarLeft(uint64_t (*rows)[2], uint8_t pixels) {
+    for(uint32_t y = 0 ; y < SCHIP_H ; y ++) {
+        rows[y][0] = (rows[y][0] << pixels) | (rows[y][1] >> (64 - pixels));
+        rows[y][1] <<= pixels;
+    }
+}
+
+static void scalarRight(uint64_t (*rows)[2], uint8_t pixels) {
+    for(uint32_t y = 0 ; y < SCHIP_H ; y ++) {
+        rows[y][1] = (rows[y][1] >> pixels) | (rows[y][0] << (64 - pixels));
+        rows[y][0] >>= pixels;
+    }
+}
+
+const ScrollKernels scrollScalar = {"scalar", &scalarLeft, &scalarRight};
+
+#ifdef SCROLL_X64
+
+//SSE2, one row per register
+//Both words are shifted together, then the bits crossing from one word
+//to the other are moved over by a byte shift of the whole register
+
+static void sse2Left(uint64_t (*rows)[2], uint8_t pixels) {
+    __m128i count = _mm_cvtsi32_si128(pixels);
+    __m128i carry = _mm_cvtsi32_si128(64 - pixels);
+
+    for(uint32_t y = 0 ; y < SCHIP_H ; y ++) {
+        __m128i row = _mm_loadu_si128((__m128i*)rows[y]);
+        __m128i moved = _mm_srli_si128(_mm_srl_epi64(row, carry), 8);
+
+        _mm_storeu_si128((__m128i*)rows[y], _mm_or_si128(_mm_sll_epi64(row, count), moved));
+    }
+}
+
+static void sse2Right(uint64_t (*rows)[2], uint8_t pixels) {
+    __m128i count = _mm_cvtsi32_si128(pixels);
+    __m128i carry = _mm_cvtsi32_si128(64 - pixels);
+
+    for(uint32_t y = 0 ; y < SCHIP_H ; y ++) {
+        __m128i row = _mm_loadu_si128((__m128i*)rows[y]);
+        __m128i moved = _mm_slli_si128(_mm_sll_epi64(row, carry), 8);
+
+        _mm_storeu_si128((__m128i*)rows[y], _mm_or_si128(_mm_srl_epi64(row, count), moved));
+    }
+}
+
+const ScrollKernels scrollSse2 = {"sse2", &sse2Left, &sse2Right};
+
+//AVX2, two rows per register
+//Byte shifts stay within each 128-bit lane, that is within each row
+
+__attribute__((target("avx2")))
+static void avx2Left(uint64_t (*rows)[2], uint8_t pixels) {
+    __m128i count = _mm_cvtsi32_si128(pixels);
+    __m128i carry = _mm_cvtsi32_si128(64 - pixels);
+
+    for(uint32_t y = 0 ; y < SCHIP_H ; y += 2) {
+        __m256i row = _mm256_loadu_si256((__m256i*)rows[y]);
+        __m256i moved = _mm256_srli_si256(_mm256_srl_epi64(row, carry), 8);
+
+        _mm256_storeu_si256((__m256i*)rows[y], _mm256_or_si256(_mm256_sll_epi64(row, count), moved));
+    }
+}
+
+__attribute__((target("avx2")))
+static void avx2Right(uint64_t (*rows)[2], uint8_t pixels) {
+    __m128i count = _mm_cvtsi32_si128(pixels);
+    __m128i carry = _mm_cvtsi32_si128(64 - pixels);
+
+    for(uint32_t y = 0 ; y < SCHIP_H ; y += 2) {
+        __m256i row = _mm256_loadu_si256((__m256i*)rows[y]);
+        __m256i moved = _mm256_slli_si256(_mm256_sll_epi64(row, carry), 8);
+
+        _mm256_storeu_si256((__m256i*)rows[y], _mm256_or_si256(_mm256_srl_epi64(row, count), moved));
+    }
+}
+
+const ScrollKernels scrollAvx2 = {"avx2", &avx2Left, &avx2Right};
+
+#endif
+
+const ScrollKernels* selectScrollKernels() {
+#ifdef SCROLL_X64
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx2"))
+        return &scrollAvx2;
+
+    if(__builtin_cpu_supports("sse2"))
+        return &scrollSse2;
+#endif
+
+    return &scrollScalar;
+}
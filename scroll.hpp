@@ -0,0 +1,56 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef SCROLL_HPP_INCLUDED
+#define SCROLL_HPP_INCLUDED
+
+#include <cstdint>
+
+//Vector kernels are built for x86-64 and picked at run time
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SCROLL_X64
+#endif
+
+//Horizontal scroll of a whole bitplane (SCHIP_H rows of two words) by 1 to 63 pixels
+typedef void (*ScrollKernel)(uint64_t (*)[2], uint8_t);
+
+//Scroll kernels for one instruction set
+struct ScrollKernels {
+    const char *name;
+    ScrollKernel left;
+    ScrollKernel right;
+};
+
+extern const ScrollKernels scrollScalar;
+
+#ifdef SCROLL_X64
+extern const ScrollKernels scrollSse2;
+extern const ScrollKernels scrollAvx2;
+#endif
+
+//Fastest kernels supported by the host
+const ScrollKernels* selectScrollKernels();
+
+#endif // SCROLL_HPP_INCLUDED
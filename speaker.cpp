@@ -0,0 +1,90 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "speaker.hpp"
+
+#include <iostream>
+
+Speaker::~Speaker() {
+    if(device != 0)
+        SDL_CloseAudioDevice(device);
+}
+
+//Open the default device for 16-bit mono output
+bool Speaker::open() {
+
+    SDL_AudioSpec want = {}, have;
+
+    want.freq = SPEAKER_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = SPEAKER_SAMPLES;
+    want.callback = &Speaker::callback;
+    want.userdata = this;
+
+    device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+
+    if(device == 0) {
+        std::cout << "Could not open audio device : " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    rate = have.freq;
+    buffer = have.samples;
+    latency = rate / 20 + buffer;
+
+    SDL_PauseAudioDevice(device, 0);
+
+    return true;
+}
+
+void Speaker::queue(const int16_t *samples, uint32_t count) {
+
+    size_t queued = ring.count();
+    size_t room = (queued < latency) ? latency - queued : 0;
+
+    if(count > room) {
+        overruns += count - room;
+        count = room;
+    }
+
+    ring.push(samples, count);
+}
+
+//Runs on SDL's audio thread
+void Speaker::callback(void *data, Uint8 *stream, int len) {
+
+    Speaker *speaker = (Speaker*)data;
+    int16_t *out = (int16_t*)stream;
+    size_t count = len / sizeof(int16_t);
+
+    size_t played = speaker->ring.pop(out, count);
+
+    for(size_t i = played ; i < count ; i++)
+        out[i] = 0;
+
+    if(played < count)
+        speaker->underruns.fetch_add(count - played, std::memory_order_relaxed);
+}
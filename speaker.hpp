@@ -0,0 +1,80 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef SPEAKER_HPP_INCLUDED
+#define SPEAKER_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <SDL2/SDL.h>
+
+#include "spsc.hpp"
+
+//Requested output rate and device buffer size
+#define SPEAKER_RATE 48000
+#define SPEAKER_SAMPLES 512
+
+//SDL audio output
+//The emulation thread queues samples into a wait-free ring buffer, and
+//SDL's audio callback plays them. Neither side ever waits : samples past
+//the latency limit are dropped, and the callback plays silence when the
+//ring buffer runs dry.
+class Speaker {
+
+public:
+
+    ~Speaker();
+
+    bool open();
+
+    //Sample rate the device was opened with
+    uint32_t rate = SPEAKER_RATE;
+
+    //Samples the device asks for at once
+    uint32_t buffer = SPEAKER_SAMPLES;
+
+    //Samples queued at most, about three frames more than the device buffer
+    uint32_t latency = SPEAKER_RATE / 20 + SPEAKER_SAMPLES;
+
+    //Samples queued and not played yet
+    size_t queued() const { return ring.count(); }
+
+    //Queue samples from the emulation thread
+    void queue(const int16_t*, uint32_t);
+
+    //Samples dropped because too many were queued, and played as silence because none were
+    uint64_t overruns = 0;
+    std::atomic<uint64_t> underruns{0};
+
+private:
+
+    SDL_AudioDeviceID device = 0;
+
+    SpscQueue<int16_t, 16384> ring;
+
+    static void callback(void*, Uint8*, int);
+};
+
+#endif // SPEAKER_HPP_INCLUDED
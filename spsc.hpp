@@ -0,0 +1,115 @@
+/**
+MIT License
+
+Copyright (c) 2021 Matthieu Le Gallic
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef SPSC_HPP_INCLUDED
+#define SPSC_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+
+//Wait-free single-producer single-consumer queue
+//Holds up to size - 1 elements, size must be a power of two.
+//push() is only called by one thread and pop() by another, neither ever blocks.
+template <typename T, size_t size>
+class SpscQueue {
+
+    static_assert((size & (size - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+
+    //Returns false when the queue is full
+    bool push(const T &item) {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) & (size - 1);
+
+        if(next == head.load(std::memory_order_acquire))
+            return false;
+
+        items[tail] = item;
+        this->tail.store(next, std::memory_order_release);
+
+        return true;
+    }
+
+    //Returns false when the queue is empty
+    bool pop(T &item) {
+        size_t head = this->head.load(std::memory_order_relaxed);
+
+        if(head == tail.load(std::memory_order_acquire))
+            return false;
+
+        item = items[head];
+        this->head.store((head + 1) & (size - 1), std::memory_order_release);
+
+        return true;
+    }
+
+    //Push up to count items, returns how many fit
+    size_t push(const T *data, size_t count) {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        size_t free = (head.load(std::memory_order_acquire) - tail - 1) & (size - 1);
+
+        if(count > free)
+            count = free;
+
+        for(size_t i = 0 ; i < count ; i++)
+            items[(tail + i) & (size - 1)] = data[i];
+
+        this->tail.store((tail + count) & (size - 1), std::memory_order_release);
+
+        return count;
+    }
+
+    //Pop up to count items, returns how many there were
+    size_t pop(T *data, size_t count) {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        size_t used = (tail.load(std::memory_order_acquire) - head) & (size - 1);
+
+        if(count > used)
+            count = used;
+
+        for(size_t i = 0 ; i < count ; i++)
+            data[i] = items[(head + i) & (size - 1)];
+
+        this->head.store((head + count) & (size - 1), std::memory_order_release);
+
+        return count;
+    }
+
+    //Items in the queue, may be outdated as soon as it returns
+    size_t count() const {
+        return (tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire)) & (size - 1);
+    }
+
+private:
+
+    T items[size];
+
+    //Producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+#endif // SPSC_HPP_INCLUDED